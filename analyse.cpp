@@ -0,0 +1,185 @@
+#include "capture.hpp"
+#include "mapped_file.hpp"
+#include "photometer.hpp"
+#include "work_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+using namespace photometer;
+
+struct Options {
+    double step = 1e-3;      // seconds between estimates
+    unsigned threads = 0;    // 0 for one per hardware thread
+    bool write_series = false;
+};
+
+// Health summary of one estimate series
+struct Summary {
+    size_t frames = 0, points = 0;
+    double min = std::numeric_limits<double>::infinity(),
+           max = -std::numeric_limits<double>::infinity(),
+           sum = 0, max_jump = 0, last = std::numeric_limits<double>::quiet_NaN();
+
+    void add(const double *estimates, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            min = std::min(min, estimates[i]);
+            max = std::max(max, estimates[i]);
+            sum += estimates[i];
+            if (points + i > 0)
+                max_jump = std::max(max_jump, std::fabs(estimates[i] - last));
+            last = estimates[i];
+        }
+        points += n;
+    }
+};
+
+std::mutex output_lock;
+
+// Arguments parsed in full, which throw std::invalid_argument if anything but the number is
+// there, and std::out_of_range if it does not fit
+unsigned parse_count(const std::string &argument) {
+    size_t parsed;
+    const unsigned long value = std::stoul(argument, &parsed);
+    if (parsed != argument.size() || argument.find('-') != std::string::npos)
+        throw std::invalid_argument(argument);
+    if (value > std::numeric_limits<unsigned>::max())
+        throw std::out_of_range(argument);
+    return value;
+}
+
+double parse_seconds(const std::string &argument) {
+    size_t parsed;
+    const double value = std::stod(argument, &parsed);
+    if (parsed != argument.size())
+        throw std::invalid_argument(argument);
+    return value;
+}
+
+// Replays one capture, estimating at every step from its first frame to its last as each frame
+// arrives. Between two frames the meter does not change, so all the points in between are one
+// estimate_series() call, and each call resumes from the bounds the last one left in the
+// workspace, so that the replay costs about one incremental resolution per frame and expiry.
+void analyse(const std::string &path, const Options &options) {
+    const MappedFile file(path.c_str());
+    const std::optional<CaptureView> capture = CaptureView::open(file.data, file.bytes);
+    if (!capture) {
+        std::lock_guard<std::mutex> lock(output_lock);
+        std::fprintf(stderr, "%s: not a readable capture\n", path.c_str());
+        return;
+    }
+
+    std::FILE *series = nullptr;
+    if (options.write_series) {
+        series = std::fopen((path + ".series.csv").c_str(), "w");
+        if (series)
+            std::fprintf(series, "t,estimate\n");
+    }
+
+    Photometer meter;
+    meter.set_incremental(true);
+    Photometer::Workspace workspace;
+    Summary summary;
+    std::vector<double> estimates;
+    double t0 = 0, next = 0;
+    size_t k = 0;  // index of the next point, at t0 + k*step
+
+    // Estimates the points before a time, from the meter as it stands
+    const auto estimate_until = [&](double until, bool inclusive) {
+        size_t n = 0;
+        while (t0 + (k + n)*options.step < until
+            || (inclusive && t0 + (k + n)*options.step == until))
+            n++;
+        if (n == 0)
+            return;
+        estimates.resize(n);
+        meter.estimate_series(next, options.step, n, estimates.data(), workspace);
+        summary.add(estimates.data(), n);
+        if (series) {
+            for (size_t i = 0; i < n; i++)
+                std::fprintf(series, "%.7f,%.1f\n", t0 + (k + i)*options.step, estimates[i]);
+        }
+        k += n;
+        next = t0 + k*options.step;
+    };
+
+    double last = 0;
+    capture->for_each_block(
+        [&](const double *timestamps, const uint8_t (*frames)[2], size_t n) {
+            if (summary.frames == 0)
+                t0 = next = timestamps[0];
+            for (size_t i = 0; i < n; i++) {
+                estimate_until(timestamps[i], false);
+                meter.consume(timestamps[i], frames[i]);
+            }
+            summary.frames += n;
+            last = timestamps[n - 1];
+        }
+    );
+    if (summary.frames > 0)
+        estimate_until(last, true);
+    if (series)
+        std::fclose(series);
+
+    std::lock_guard<std::mutex> lock(output_lock);
+    std::printf(
+        "%s,%zu,%zu,%.1f,%.1f,%.1f,%.1f\n",
+        path.c_str(), summary.frames, summary.points, summary.min,
+        summary.points? summary.sum/summary.points: std::nan(""), summary.max, summary.max_jump
+    );
+    std::fflush(stdout);
+}
+
+}
+
+
+// Analyses many captures in parallel, one task per file, and prints a CSV summary of each
+// estimate series as soon as it is done
+int main(int argc, char **argv) {
+    Options options;
+    std::vector<std::string> paths;
+    bool valid = true;
+    try {
+        for (int i = 1; i < argc; i++) {
+            if (!std::strcmp(argv[i], "-j") && i + 1 < argc)
+                options.threads = parse_count(argv[++i]);
+            else if (!std::strcmp(argv[i], "-s") && i + 1 < argc)
+                options.step = parse_seconds(argv[++i]);
+            else if (!std::strcmp(argv[i], "-w"))
+                options.write_series = true;
+            else paths.push_back(argv[i]);
+        }
+    }
+    catch (const std::logic_error &) {  // std::invalid_argument or std::out_of_range
+        valid = false;
+    }
+    if (!valid || paths.empty() || !(options.step > 0)) {
+        std::fprintf(
+            stderr, "usage: %s [-j threads] [-s step_s] [-w] capture...\n"
+            "  -w also writes each series to <capture>.series.csv\n", argv[0]
+        );
+        return 2;
+    }
+
+    std::printf("file,frames,points,min,mean,max,max_jump\n");
+    std::fflush(stdout);
+    WorkStealingPool pool(options.threads);
+    for (const std::string &path: paths)
+        pool.submit([&path, &options]() { analyse(path, options); });
+    pool.wait();
+    return 0;
+}
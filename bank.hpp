@@ -0,0 +1,149 @@
+#ifndef BANK_HPP
+#define BANK_HPP
+
+#include "photometer.hpp"
+
+#include <barrier>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+namespace photometer {
+
+// Many sensors in one engine. Each sensor has a PackedPhotometer, and their effective bounds are
+// cached in structure-of-arrays blocks together with the interval for which they hold, so that
+// estimating every sensor is a refresh of the stale ones followed by one vectorisable sweep.
+//
+// Sensors can be split over worker threads. Each worker owns a contiguous block of sensors for
+// the bank's lifetime, so that a sensor's samples and cached bounds stay in one core's cache and
+// workers do not write to the same cache lines. The calling thread takes the first block.
+class PhotometerBank {
+public:
+    explicit PhotometerBank(
+        size_t sensors,
+        unsigned threads = 1  // including the calling thread
+    ):
+        meters(sensors),
+        lower(sensors), upper(sensors), from(sensors), until(sensors),
+        sync(std::max(1u, threads))
+    {
+        invalidate();
+        for (unsigned w = 1; w < std::max(1u, threads); w++)
+            workers.emplace_back([this, w]() { work(w); });
+    }
+
+    ~PhotometerBank() {
+        run(nullptr);
+        for (std::thread &worker: workers)
+            worker.join();
+    }
+
+    PhotometerBank(const PhotometerBank &) = delete;
+    PhotometerBank &operator=(const PhotometerBank &) = delete;
+
+    size_t sensors() const { return meters.size(); }
+    const PackedPhotometer &sensor(size_t id) const { return meters[id]; }
+
+    void consume(
+        size_t sensor,
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        meters[sensor].consume(now, data);
+        from[sensor] = std::numeric_limits<double>::infinity();
+    }
+
+    // Frames tagged with the id of the sensor that sent them. Each owner consumes the frames of
+    // its sensors in order, so each sensor sees the same sequence as if they were consumed singly.
+    void consume_batch(
+        const uint16_t *sensor_ids,
+        const double *timestamps,    // monotonic seconds
+        const uint8_t (*frames)[2],  // raw from the sensor
+        size_t count
+    ) {
+        run([=, this](size_t first, size_t last) {
+            for (size_t i = 0; i < count; i++) {
+                const size_t id = sensor_ids[i];
+                if (id >= first && id < last)
+                    consume(id, timestamps[i], frames[i]);
+            }
+        });
+    }
+
+    // Estimates of every sensor as of now, into out[sensors()]
+    void estimate_all(
+        double now,  // monotonic seconds
+        double *out
+    ) {
+        run([this, now](size_t first, size_t last) {
+            for (size_t id = first; id < last; id++) {
+                if (now < from[id] || now >= until[id]) {
+                    // The estimate cannot change before the next end, nor after the last consume
+                    lower[id] = meters[id].lower(now);
+                    upper[id] = meters[id].upper(now);
+                    from[id] = now;
+                    until[id] = meters[id].next_change_time(now);
+                }
+            }
+        });
+
+        const size_t n = meters.size();
+        for (size_t id = 0; id < n; id++)
+            out[id] = 0.5*(lower[id] + upper[id]);
+    }
+
+private:
+    typedef std::function<void(size_t first, size_t last)> Job;
+
+    void invalidate() {
+        std::fill(from.begin(), from.end(), std::numeric_limits<double>::infinity());
+    }
+
+    // Sensors owned by a worker, with the calling thread as worker 0
+    std::pair<size_t, size_t> block(unsigned worker) const {
+        const size_t n = meters.size(), threads = workers.size() + 1;
+        return { n*worker/threads, n*(worker + 1)/threads };
+    }
+
+    // Runs a job over every worker's block and waits for all of them; an empty job stops them
+    void run(Job next) {
+        if (workers.empty()) {
+            if (next)
+                next(0, meters.size());
+            return;
+        }
+        job = std::move(next);
+        sync.arrive_and_wait();
+        if (!job)
+            return;
+        const auto [first, last] = block(0);
+        job(first, last);
+        sync.arrive_and_wait();
+    }
+
+    void work(unsigned worker) {
+        for (;;) {
+            sync.arrive_and_wait();
+            if (!job)
+                return;
+            const auto [first, last] = block(worker);
+            job(first, last);
+            sync.arrive_and_wait();
+        }
+    }
+
+    std::vector<PackedPhotometer> meters;
+    // Effective bounds of each sensor over the half-open interval [from, until)
+    std::vector<double> lower, upper, from, until;
+
+    Job job;
+    std::barrier<> sync;
+    std::vector<std::thread> workers;
+};
+
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "engines.hpp"
+#include "notifier.hpp"
+#include "photometer.hpp"
+#include "streams.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+// The replacement operator delete below frees what the replacement operator new mallocs, but GCC
+// warns about a mismatch wherever it inlines the free into the standard allocators
+#if defined(__GNUC__) && !defined(__clang__)
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+
+namespace {
+
+// Totals over every allocation made through the global operator new
+std::size_t allocated_bytes = 0, allocation_count = 0;
+
+}
+
+void *operator new(std::size_t size) {
+    allocated_bytes += size;
+    allocation_count++;
+    if (void *p = std::malloc(size? size: 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { ::operator delete(p); }
+
+
+namespace {
+
+// The standard new_delete_resource() may call the aligned operator new, which is not replaced, so
+// the default resource is this one instead, for meters with allocators to be counted the same
+class GlobalNewResource: public std::pmr::memory_resource {
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        assert(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        return ::operator new(bytes);
+    }
+
+    void do_deallocate(void *p, std::size_t, std::size_t) noexcept override { ::operator delete(p); }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+} global_new;
+
+}
+
+
+namespace {
+
+using namespace photometer;
+using namespace photometer::streams;
+
+struct Result {
+    double consume_ns, estimate_ns;
+    size_t estimates, peak_size, bytes, allocations;
+};
+
+// A meter behind a ChangeNotifier, with its timer served before any frame later than the deadline,
+// and estimates read from what the notifier last reported rather than resolved as of now
+template <typename Meter>
+class Notified {
+public:
+    void consume(double now, const uint8_t (&data)[2]) {
+        if (notifier.next_deadline() < now)
+            notifier.advance(notifier.next_deadline());
+        notifier.consume(now, data);
+    }
+
+    double estimate(double) const { return notifier.current().estimate; }
+    size_t size() const { return notifier.meter().size(); }
+
+private:
+    ChangeNotifier<Meter> notifier;
+};
+
+template <typename Meter>
+Result run(const std::vector<Frame> &frames, double rate_hz, unsigned repeats) {
+    using Clock = std::chrono::steady_clock;
+    const size_t stride = std::max<size_t>(1, rate_hz/kEstimateRateHz);
+    Result best {
+        .consume_ns = std::numeric_limits<double>::max(),
+        .estimate_ns = std::numeric_limits<double>::max(),
+    };
+
+    for (unsigned r = 0; r < repeats; r++) {
+        allocated_bytes = 0;
+        allocation_count = 0;
+        Clock::duration consuming {}, estimating {};
+        size_t estimates = 0, peak_size = 0;
+        volatile double sink;
+        {
+            Meter meter;
+            for (size_t i = 0; i < frames.size(); i += stride) {
+                const size_t end = std::min(frames.size(), i + stride);
+                const Clock::time_point t0 = Clock::now();
+                for (size_t j = i; j < end; j++)
+                    meter.consume(frames[j].now, frames[j].data);
+                const Clock::time_point t1 = Clock::now();
+                sink = meter.estimate(frames[end - 1].now);
+                const Clock::time_point t2 = Clock::now();
+
+                consuming += t1 - t0;
+                estimating += t2 - t1;
+                estimates++;
+                peak_size = std::max(peak_size, meter.size());
+            }
+        }
+        (void)sink;
+
+        const double ns = std::chrono::duration<double, std::nano>(1).count();
+        best.consume_ns = std::min(best.consume_ns, consuming/Clock::duration(1)/ns/frames.size());
+        best.estimate_ns = std::min(best.estimate_ns, estimating/Clock::duration(1)/ns/estimates);
+        best.estimates = estimates;
+        best.peak_size = peak_size;
+        best.bytes = allocated_bytes;
+        best.allocations = allocation_count;
+    }
+    return best;
+}
+
+void report(const char *scenario, const char *engine, size_t frames, const Result &result) {
+    std::printf(
+        "%s,%s,%zu,%zu,%.1f,%.1f,%zu,%zu,%zu\n",
+        scenario, engine, frames, result.estimates, result.consume_ns, result.estimate_ns,
+        result.peak_size, result.bytes, result.allocations
+    );
+}
+
+}
+
+
+// Prints one CSV row per scenario and engine. Timings are the best of several repeats, and every
+// stream is generated from a fixed seed, so that results can be compared between releases.
+int main(int argc, char **argv) {
+    const unsigned repeats = argc > 1? std::stoul(argv[1]): 3;
+    std::pmr::set_default_resource(&global_new);
+
+    std::printf(
+        "scenario,engine,frames,estimates,consume_ns,estimate_ns,peak_size,alloc_bytes,allocations\n"
+    );
+    for (const Scenario &scenario: scenarios) {
+        const std::vector<Frame> frames = generate(scenario);
+        const double rate = scenario.rate_hz;
+        report(scenario.name, "Photometer", frames.size(), run<Photometer>(frames, rate, repeats));
+        report(scenario.name, "ChangeNotifier<Photometer>", frames.size(), run<Notified<Photometer>>(frames, rate, repeats));
+        report(scenario.name, "IncrementalPhotometer", frames.size(), run<IncrementalPhotometer>(frames, rate, repeats));
+        report(scenario.name, "WheelPhotometer", frames.size(), run<WheelPhotometer>(frames, rate, repeats));
+        report(scenario.name, "CompactPhotometer", frames.size(), run<CompactPhotometer>(frames, rate, repeats));
+        report(scenario.name, "PackedPhotometer", frames.size(), run<PackedPhotometer>(frames, rate, repeats));
+        report(scenario.name, "BitsetPhotometer", frames.size(), run<BitsetPhotometer>(frames, rate, repeats));
+        report(scenario.name, "StaticPhotometer<256>", frames.size(), run<StaticPhotometer<256>>(frames, rate, repeats));
+    }
+    return 0;
+}
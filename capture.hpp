@@ -0,0 +1,196 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include "photometer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+
+namespace photometer {
+
+// Recorded sensor traffic, laid out so that a replay reads the frames in place:
+//
+//   offset  size    field
+//   0       8       magic, "DIMBCAP" and a format version byte
+//   8       8       frame count n, unsigned
+//   16      8       timestamp of the first frame, monotonic seconds, IEEE 754 double
+//   24      8       timestamp resolution (tick), seconds, IEEE 754 double
+//   32      2n      frames, exactly as received from the sensor
+//   32+2n   ...     n timestamps, each as the unsigned LEB128 number of ticks since the previous
+//                   one (the first is 0)
+//
+// All fields are little-endian. At 10 kHz with 100 ns ticks, each delta takes two bytes, so a
+// frame costs four bytes in all.
+namespace capture {
+
+inline constexpr uint8_t kMagic[8] = { 'D', 'I', 'M', 'B', 'C', 'A', 'P', 1 };
+inline constexpr size_t kHeaderBytes = 32;
+inline constexpr double kDefaultTickS = 100e-9;
+
+inline void put_u64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out[i] = value >> 8*i & 0xff;
+}
+
+inline uint64_t get_u64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= uint64_t(in[i]) << 8*i;
+    return value;
+}
+
+}
+
+// Accumulates frames as received and writes them out as one capture. Timestamps are rounded to
+// the nearest tick since the first frame, and must not decrease.
+class CaptureWriter {
+public:
+    explicit CaptureWriter(double tick = capture::kDefaultTickS): tick(tick) { }
+
+    size_t size() const { return frames.size(); }
+
+    void add(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        if (frames.empty())
+            first = now;
+        const uint64_t ticks = std::llround((now - first)/tick);
+        assert(ticks >= last_ticks);
+        uint64_t delta = ticks - last_ticks;
+        last_ticks = ticks;
+
+        frames.push_back({ data[0], data[1] });
+        do {
+            deltas.push_back((delta & 0x7f) | (delta > 0x7f? 0x80: 0));
+            delta >>= 7;
+        } while (delta);
+    }
+
+    void write(std::ostream &out) const {
+        uint8_t header[capture::kHeaderBytes];
+        std::memcpy(header, capture::kMagic, sizeof capture::kMagic);
+        capture::put_u64(header + 8, frames.size());
+        capture::put_u64(header + 16, std::bit_cast<uint64_t>(frames.empty()? 0.: first));
+        capture::put_u64(header + 24, std::bit_cast<uint64_t>(tick));
+        out.write(reinterpret_cast<const char *>(header), sizeof header);
+        out.write(reinterpret_cast<const char *>(frames.data()), 2*frames.size());
+        out.write(reinterpret_cast<const char *>(deltas.data()), deltas.size());
+    }
+
+private:
+    double tick, first = 0;
+    uint64_t last_ticks = 0;
+    std::vector<std::array<uint8_t, 2>> frames;
+    std::vector<uint8_t> deltas;
+};
+
+// A capture in memory, such as a mapped file, which must outlive the view. The frames are read
+// in place; only the timestamps are decoded, a block at a time into a buffer on the stack.
+class CaptureView {
+public:
+    // Empty if the bytes are not a whole, well-formed capture
+    static std::optional<CaptureView> open(const uint8_t *data, size_t bytes) {
+        if (bytes < capture::kHeaderBytes
+            || std::memcmp(data, capture::kMagic, sizeof capture::kMagic) != 0)
+            return std::nullopt;
+        CaptureView view;
+        view.count = capture::get_u64(data + 8);
+        view.first = std::bit_cast<double>(capture::get_u64(data + 16));
+        view.tick = std::bit_cast<double>(capture::get_u64(data + 24));
+        if (view.count > (bytes - capture::kHeaderBytes)/2 || !(view.tick > 0))
+            return std::nullopt;
+        view.frames = reinterpret_cast<const uint8_t (*)[2]>(data + capture::kHeaderBytes);
+        view.deltas = data + capture::kHeaderBytes + 2*view.count;
+        view.deltas_end = data + bytes;
+
+        // Every delta must be complete and fit in 64 bits, as must their sum, so that timestamps
+        // never decrease, and nothing may follow the last
+        size_t deltas = 0;
+        uint64_t ticks = 0;
+        for (const uint8_t *p = view.deltas; p != view.deltas_end; deltas++) {
+            uint64_t delta = 0;
+            for (unsigned shift = 0;; shift += 7) {
+                // The tenth byte holds bit 63 alone, and ends the number
+                if (p == view.deltas_end || (shift == 63 && *p > 1))
+                    return std::nullopt;
+                delta |= uint64_t(*p & 0x7f) << shift;
+                if (!(*p++ & 0x80))
+                    break;
+            }
+            if (ticks + delta < ticks)
+                return std::nullopt;
+            ticks += delta;
+        }
+        if (deltas != view.count)
+            return std::nullopt;
+        return view;
+    }
+
+    size_t size() const { return count; }
+    double tick_s() const { return tick; }
+
+    // Calls visit(timestamps, frames, n) over consecutive blocks of at most
+    // FrameBlock::kCapacity frames, in order
+    template <typename Visit>
+    void for_each_block(Visit visit) const {
+        double timestamps[FrameBlock::kCapacity];
+        const uint8_t *p = deltas;
+        uint64_t ticks = 0;
+        for (size_t i = 0; i < count; i += FrameBlock::kCapacity) {
+            const size_t n = std::min(count - i, FrameBlock::kCapacity);
+            for (size_t j = 0; j < n; j++) {
+                uint64_t delta = 0;
+                for (unsigned shift = 0;; shift += 7) {
+                    delta |= uint64_t(*p & 0x7f) << shift;
+                    if (!(*p++ & 0x80))
+                        break;
+                }
+                ticks += delta;
+                timestamps[j] = first + ticks*tick;
+            }
+            visit(static_cast<const double *>(timestamps), frames + i, n);
+        }
+    }
+
+    // Consumes every frame into the meter, in batches if it has consume_batch(), and returns the
+    // timestamp of the last one
+    template <typename Meter>
+    double replay(Meter &meter) const {
+        double last = first;
+        for_each_block(
+            [&meter, &last](const double *timestamps, const uint8_t (*frames)[2], size_t n) {
+                if constexpr (requires { meter.consume_batch(timestamps, frames, n); })
+                    meter.consume_batch(timestamps, frames, n);
+                else {
+                    for (size_t i = 0; i < n; i++)
+                        meter.consume(timestamps[i], frames[i]);
+                }
+                last = timestamps[n - 1];
+            }
+        );
+        return last;
+    }
+
+private:
+    CaptureView() = default;
+
+    size_t count;
+    double first, tick;
+    const uint8_t (*frames)[2];
+    const uint8_t *deltas, *deltas_end;
+};
+
+}
+
+#endif
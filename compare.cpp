@@ -0,0 +1,72 @@
+#include "engines.hpp"
+#include "photometer.hpp"
+#include "streams.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+namespace {
+
+using namespace photometer;
+using namespace photometer::streams;
+
+using Harness = EngineHarness<
+    IncrementalPhotometer, WheelPhotometer, CompactPhotometer, PackedPhotometer, BitsetPhotometer, StaticPhotometer<256>
+>;
+
+// Estimates are checked as of the latest frame and these offsets after it
+constexpr double kFutures[] = { 0, 0.01, 0.3, 3 };
+
+// Returns whether every engine agreed with the oracle throughout
+bool compare(const Scenario &scenario) {
+    const std::vector<Frame> stream = generate(scenario);
+    std::vector<double> timestamps;
+    std::vector<std::array<uint8_t, 2>> frames;
+    for (const Frame &frame: stream) {
+        timestamps.push_back(frame.now);
+        frames.push_back({ frame.data[0], frame.data[1] });
+    }
+
+    Harness harness;
+    bool agreed = true;
+    const size_t stride = std::max<size_t>(1, scenario.rate_hz/kEstimateRateHz);
+    for (size_t i = 0; i < stream.size(); i += stride) {
+        const size_t n = std::min(stream.size() - i, stride);
+        harness.consume(
+            timestamps.data() + i, reinterpret_cast<const uint8_t (*)[2]>(frames.data() + i), n
+        );
+        for (double future: kFutures)
+            agreed &= harness.check(timestamps[i + n - 1] + future);
+    }
+
+    for (const Harness::Result &result: harness.results()) {
+        std::printf(
+            "%s,%s,%zu,%zu,%zu,%.1f,%.1f\n",
+            scenario.name, result.engine, harness.frames(), harness.estimates(), result.checked,
+            result.consume_s*1e9/harness.frames(), result.estimate_s*1e9/harness.estimates()
+        );
+        if (result.differed)
+            std::fprintf(stderr, "%s: %s differed from Photometer\n", scenario.name, result.engine);
+    }
+    std::fflush(stdout);
+    return agreed;
+}
+
+}
+
+
+// Feeds every synthetic stream to every engine at once, checking each estimate against
+// Photometer's, and prints one CSV row per scenario and engine with its throughput and how many
+// estimates were checked. Exits with 1 if any engine ever differed.
+int main() {
+    std::printf("scenario,engine,frames,estimates,checked,consume_ns,estimate_ns\n");
+    bool agreed = true;
+    for (const Scenario &scenario: scenarios)
+        agreed &= compare(scenario);
+    return agreed? 0: 1;
+}
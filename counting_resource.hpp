@@ -0,0 +1,66 @@
+#ifndef COUNTING_RESOURCE_HPP
+#define COUNTING_RESOURCE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+
+
+namespace photometer {
+
+// Memory resource that passes every request on to an upstream one and accounts for it, to measure
+// what a meter given it allocates, and to set budgets from that:
+//
+//     CountingResource counter;
+//     Photometer meter(&counter);
+//     ...
+//     assert(counter.peak_bytes() <= kBudgetBytes);
+//
+// Bytes are as requested, not including the upstream resource's own overhead. Like the meters, it
+// is not thread-safe.
+class CountingResource: public std::pmr::memory_resource {
+public:
+    explicit CountingResource(
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource()
+    ): upstream(upstream) { }
+
+    CountingResource(const CountingResource &) = delete;
+    CountingResource &operator=(const CountingResource &) = delete;
+
+    std::pmr::memory_resource *upstream_resource() const { return upstream; }
+
+    // Currently allocated, and the most ever allocated at once
+    size_t bytes() const { return current_bytes; }
+    size_t peak_bytes() const { return peak; }
+
+    // Allocations made so far, including those since freed
+    size_t allocations() const { return allocation_count; }
+
+    // Starts measuring the peak again from what is allocated now
+    void reset_peak() { peak = current_bytes; }
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        void *p = upstream->allocate(bytes, alignment);
+        current_bytes += bytes;
+        peak = std::max(peak, current_bytes);
+        allocation_count++;
+        return p;
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+        upstream->deallocate(p, bytes, alignment);
+        current_bytes -= bytes;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource *upstream;
+    size_t current_bytes = 0, peak = 0, allocation_count = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef ENGINES_HPP
+#define ENGINES_HPP
+
+#include "photometer.hpp"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+
+namespace photometer {
+
+// What every engine provides: frames in, estimates out, with the same meaning as Photometer's,
+// which is the reference for them all
+template <typename Meter>
+concept Engine = std::default_initializable<Meter>
+    && requires(Meter &meter, const Meter &view, double now, const uint8_t (&data)[2]) {
+        meter.consume(now, data);
+        { view.estimate(now) } -> std::same_as<double>;
+        { view.size() } -> std::convertible_to<size_t>;
+    };
+
+// Photometer in incremental mode, as an engine of its own
+struct IncrementalPhotometer: Photometer {
+    IncrementalPhotometer() { set_incremental(true); }
+};
+
+template <typename Meter>
+inline constexpr const char *kEngineName = nullptr;
+
+template <> inline constexpr const char *kEngineName<Photometer> = "Photometer";
+template <> inline constexpr const char *kEngineName<IncrementalPhotometer> = "IncrementalPhotometer";
+template <> inline constexpr const char *kEngineName<InstrumentedPhotometer> = "InstrumentedPhotometer";
+template <> inline constexpr const char *kEngineName<WheelPhotometer> = "WheelPhotometer";
+template <> inline constexpr const char *kEngineName<CompactPhotometer> = "CompactPhotometer";
+template <> inline constexpr const char *kEngineName<PackedPhotometer> = "PackedPhotometer";
+template <> inline constexpr const char *kEngineName<BitsetPhotometer> = "BitsetPhotometer";
+template <size_t N> inline constexpr const char *kEngineName<StaticPhotometer<N>> = "StaticPhotometer";
+
+// Whether an engine's estimates as of some time must equal Photometer's bit for bit as it stands.
+// Every engine's must, except that StaticPhotometer drops samples once it is full, and so only has
+// to until it first evicts one, and that CompactPhotometer only has to when it is exact().
+template <typename Meter>
+constexpr bool must_agree(const Meter &, double) { return true; }
+
+template <size_t N>
+bool must_agree(const StaticPhotometer<N> &meter, double) { return meter.evictions() == 0; }
+
+inline bool must_agree(const CompactPhotometer &meter, double now) { return meter.exact(now); }
+
+// Feeds one frame stream to several engines at once, with Photometer alongside as the oracle, and
+// compares their estimates to the oracle's bit for bit, whenever must_agree() holds. Time spent in
+// each engine is accumulated per call, so that blocks of frames rather than single frames should
+// be consumed between checks. Result 0 is the oracle; the others follow in the order of the
+// engines.
+template <Engine... Meters>
+class EngineHarness {
+public:
+    static constexpr size_t kEngines = 1 + sizeof...(Meters);
+
+    struct Result {
+        const char *engine;
+        double consume_s = 0, estimate_s = 0;
+        size_t checked = 0;    // estimates compared to the oracle's
+        bool differed = false;
+    };
+
+    EngineHarness(): results_ {
+        Result { .engine = kEngineName<Photometer> },
+        Result { .engine = kEngineName<Meters> }...
+    } { }
+
+    const std::array<Result, kEngines> &results() const { return results_; }
+    size_t frames() const { return frame_count; }
+    size_t estimates() const { return estimate_count; }
+
+    void consume(
+        const double *timestamps,    // monotonic seconds
+        const uint8_t (*frames)[2],  // raw from the sensor
+        size_t count
+    ) {
+        const auto feed = [=](auto &meter, Result &result) {
+            timed(result.consume_s, [&]() {
+                for (size_t i = 0; i < count; i++)
+                    meter.consume(timestamps[i], frames[i]);
+            });
+        };
+        feed(oracle, results_[0]);
+        for_each_engine(feed);
+        frame_count += count;
+    }
+
+    // Estimates with every engine as of now, and returns whether all those that must agreed with
+    // the oracle
+    bool check(
+        double now  // monotonic seconds
+    ) {
+        double expected;
+        timed(results_[0].estimate_s, [&]() { expected = oracle.estimate(now); });
+        results_[0].checked++;
+        bool agreed = true;
+        for_each_engine([&](auto &meter, Result &result) {
+            double estimate;
+            timed(result.estimate_s, [&]() { estimate = meter.estimate(now); });
+            if (!must_agree(meter, now))
+                return;
+            result.checked++;
+            if (std::bit_cast<uint64_t>(estimate) != std::bit_cast<uint64_t>(expected)) {
+                result.differed = true;
+                agreed = false;
+            }
+        });
+        estimate_count++;
+        return agreed;
+    }
+
+private:
+    template <typename Call>
+    static void timed(double &total, Call call) {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        call();
+        total += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Calls visit(meter, result) for each engine but the oracle
+    template <typename Visit>
+    void for_each_engine(Visit visit) {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (visit(std::get<I>(engines), results_[I + 1]), ...);
+        }(std::index_sequence_for<Meters...>());
+    }
+
+    Photometer oracle;
+    std::tuple<Meters...> engines;
+    std::array<Result, kEngines> results_;
+    size_t frame_count = 0, estimate_count = 0;
+};
+
+}
+
+#endif
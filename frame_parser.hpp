@@ -0,0 +1,224 @@
+#ifndef FRAME_PARSER_HPP
+#define FRAME_PARSER_HPP
+
+#include "photometer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+
+
+namespace photometer {
+
+// Splits a raw byte stream from the bus into frames, and consumes them into a meter in batches
+// read in place from the receive buffer. Only frames held across chunks are copied.
+//
+// Frames carry no sync bits, so a dropped byte is found from its effect: bounds track the
+// illuminance, so consecutive VAL codes are close together, but frames read one byte out of
+// phase put unrelated bits into VAL. Over each window of frames the parser counts large VAL
+// jumps both in phase and one byte out of phase, and skips a byte when the out-of-phase reading
+// is clearly more plausible.
+//
+// Misaligned frames can carry anything, including CLR, confidence 3 and the longest horizon, so
+// none may reach the meter. A byte dropped late in a window may leave too few jumps in it to
+// tell, so a window's frames are held until the window after it is found in phase as well. On a
+// resync, every frame held is dropped. Frames thus reach the meter between one and two windows
+// after they arrive; flush() judges and releases those still held at the end of a stream.
+class FrameParser {
+public:
+    static constexpr unsigned kWindow = 64;      // frames per plausibility check
+    static constexpr int kMaxStep = 32;          // greatest plausible VAL change between frames
+    static constexpr unsigned kMinJumps = kWindow/4;
+
+    // Frames consumed into the meter, and dropped as misaligned
+    size_t frames() const { return frame_count; }
+    size_t dropped() const { return dropped_count; }
+    size_t resyncs() const { return resync_count; }
+
+    // All frames completed by a chunk are stamped with its time of receipt
+    template <typename Meter>
+    void feed(
+        double now,                      // monotonic seconds
+        std::span<const uint8_t> bytes,  // raw from the bus
+        Meter &meter
+    ) {
+        const auto skip = [this, &bytes]() {
+            if (bytes.empty())
+                skip_next = true;
+            else bytes = bytes.subspan(1);
+        };
+        if (skip_next && !bytes.empty()) {
+            skip_next = false;
+            skip();
+        }
+
+        if (has_partial && !bytes.empty()) {
+            hold(now, { partial, bytes[0] });
+            has_partial = false;
+            bytes = bytes.subspan(1);
+            if (judge(held[held_count - 1], bytes.empty()? nullptr: bytes.data(), meter))
+                skip();
+        }
+
+        // Runs of whole frames in place, up to each resync, of which those still held at the end
+        // are copied
+        while (bytes.size() >= 2) {
+            const uint8_t (*frames)[2] = reinterpret_cast<const uint8_t (*)[2]>(bytes.data());
+            const size_t n = bytes.size()/2;
+            run = frames;
+            run_count = 0;
+            run_time = now;
+            size_t i = 0;
+            bool resync = false;
+            while (i < n && !resync) {
+                run_count++;
+                resync = judge(frames[i], 2*i + 2 < bytes.size()? &bytes[2*i + 2]: nullptr, meter);
+                i++;
+            }
+            bytes = bytes.subspan(2*i);
+            if (resync)
+                skip();
+            for (size_t j = 0; j < run_count; j++)
+                hold(now, { run[j][0], run[j][1] });
+            run_count = 0;
+        }
+
+        if (!bytes.empty()) {
+            partial = bytes[0];
+            has_partial = true;
+        }
+    }
+
+    // Judges the frames of the window in progress on their own, and consumes all the frames held
+    // if they are in phase, or drops them if not; for the end of a stream
+    template <typename Meter>
+    void flush(Meter &meter) {
+        if (window > 0 && misaligned()) {
+            dropped_count += held_count;
+            held_count = 0;
+        }
+        else release(held_count, meter);
+        window = in_phase_jumps = out_of_phase_jumps = 0;
+    }
+
+private:
+    enum class Verdict { kUndecided, kAligned, kMisaligned };
+
+    static int value_code(uint8_t low, uint8_t high) {
+        return static_cast<int8_t>((low | high << 8) >> 3 & 0xff);
+    }
+
+    bool misaligned() const {
+        return in_phase_jumps*kWindow >= kMinJumps*window && 4*out_of_phase_jumps <= in_phase_jumps;
+    }
+
+    // Scores a frame, given the byte after it if known, and judges the window once it is complete
+    Verdict check(const uint8_t (&frame)[2], const uint8_t *next) {
+        const int in_phase = value_code(frame[0], frame[1]);
+        in_phase_jumps += std::abs(in_phase - last_in_phase) > kMaxStep;
+        last_in_phase = in_phase;
+        if (next) {
+            const int out_of_phase = value_code(frame[1], *next);
+            out_of_phase_jumps += std::abs(out_of_phase - last_out_of_phase) > kMaxStep;
+            last_out_of_phase = out_of_phase;
+        }
+
+        if (++window < kWindow)
+            return Verdict::kUndecided;
+        const bool resync = misaligned();
+        window = in_phase_jumps = out_of_phase_jumps = 0;
+        if (resync) {
+            resync_count++;
+            last_in_phase = last_out_of_phase;
+            return Verdict::kMisaligned;
+        }
+        return Verdict::kAligned;
+    }
+
+    // Checks the latest frame held, and consumes or drops what its window decides. Returns
+    // whether to skip a byte.
+    template <typename Meter>
+    bool judge(const uint8_t (&frame)[2], const uint8_t *next, Meter &meter) {
+        switch (check(frame, next)) {
+        case Verdict::kUndecided:
+            return false;
+        case Verdict::kAligned:
+            // The window before this one is now confirmed
+            release(held_count + run_count - kWindow, meter);
+            return false;
+        case Verdict::kMisaligned:
+            dropped_count += held_count + run_count;
+            held_count = run_count = 0;
+            return true;
+        }
+        return false;
+    }
+
+    void hold(double now, const std::array<uint8_t, 2> &frame) {
+        assert(held_count < 2*kWindow);
+        held_times[held_count] = now;
+        held[held_count][0] = frame[0];
+        held[held_count][1] = frame[1];
+        held_count++;
+    }
+
+    // Consumes the first n frames held, those copied first and then those of the run in place
+    template <typename Meter>
+    void release(size_t n, Meter &meter) {
+        const size_t copied = std::min(n, held_count);
+        for (size_t i = 0, j; i < copied; i = j) {
+            for (j = i + 1; j < copied && held_times[j] == held_times[i]; j++) { }
+            consume(held_times[i], held + i, j - i, meter);
+        }
+        std::copy(held_times + copied, held_times + held_count, held_times);
+        std::memmove(held, held + copied, sizeof held[0]*(held_count - copied));
+        held_count -= copied;
+
+        n -= copied;
+        assert(n <= run_count);
+        if (n > 0) {
+            consume(run_time, run, n, meter);
+            run += n;
+            run_count -= n;
+        }
+    }
+
+    template <typename Meter>
+    void consume(double now, const uint8_t (*frames)[2], size_t n, Meter &meter) {
+        frame_count += n;
+        if constexpr (requires(const double *t) { meter.consume_batch(t, frames, n); }) {
+            double timestamps[FrameBlock::kCapacity];
+            std::fill(std::begin(timestamps), std::end(timestamps), now);
+            for (size_t i = 0; i < n; i += FrameBlock::kCapacity)
+                meter.consume_batch(timestamps, frames + i, std::min(n - i, FrameBlock::kCapacity));
+        }
+        else {
+            for (size_t i = 0; i < n; i++)
+                meter.consume(now, frames[i]);
+        }
+    }
+
+    // Frames not yet confirmed in phase: copies from earlier chunks, then a run in place in the
+    // chunk being fed
+    double held_times[2*kWindow];
+    uint8_t held[2*kWindow][2];
+    size_t held_count = 0;
+    const uint8_t (*run)[2] = nullptr;
+    size_t run_count = 0;
+    double run_time = 0;
+
+    size_t frame_count = 0, dropped_count = 0, resync_count = 0;
+    unsigned window = 0, in_phase_jumps = 0, out_of_phase_jumps = 0;
+    int last_in_phase = 0, last_out_of_phase = 0;
+    uint8_t partial = 0;
+    bool has_partial = false, skip_next = false;
+};
+
+}
+
+#endif
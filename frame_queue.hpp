@@ -0,0 +1,89 @@
+#ifndef FRAME_QUEUE_HPP
+#define FRAME_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace photometer {
+
+// Wait-free single-producer, single-consumer ring of timestamped frames. The producer side is a
+// few loads and stores with no allocation or locking, so that it can run in the bus receive
+// handler; the consumer drains whole runs of frames into the estimator in batches, so that the
+// receive latency does not depend on the cost of estimation.
+template <size_t kCapacity = 4096>
+class FrameQueue {
+    static_assert(
+        kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two"
+    );
+    static_assert(std::atomic<size_t>::is_always_lock_free);
+
+public:
+    // Producer only. Returns false and counts the frame as dropped if the queue is full.
+    bool push(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) noexcept {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == kCapacity) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == kCapacity) {
+                dropped_frames.store(
+                    dropped_frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed
+                );
+                return false;
+            }
+        }
+        timestamps[t & (kCapacity - 1)] = now;
+        frames[t & (kCapacity - 1)][0] = data[0];
+        frames[t & (kCapacity - 1)][1] = data[1];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Consumes every frame pushed so far into the meter, in at most two batches
+    // read in place from the ring, and returns how many there were.
+    template <typename Meter>
+    size_t drain(Meter &meter) {
+        const size_t h = head.load(std::memory_order_relaxed),
+                     t = tail.load(std::memory_order_acquire);
+        for (size_t i = h; i != t;) {
+            const size_t offset = i & (kCapacity - 1),
+                         n = std::min(t - i, kCapacity - offset);
+            if constexpr (requires { meter.consume_batch(timestamps, frames, n); })
+                meter.consume_batch(timestamps + offset, frames + offset, n);
+            else {
+                for (size_t j = offset; j < offset + n; j++)
+                    meter.consume(timestamps[j], frames[j]);
+            }
+            i += n;
+        }
+        head.store(t, std::memory_order_release);
+        return t - h;
+    }
+
+    // Approximate when read concurrently with the other side
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t dropped() const { return dropped_frames.load(std::memory_order_relaxed); }
+
+private:
+    // Indices increase forever and wrap by masking; each is written by one side only, and kept on
+    // its own cache line with the state private to that side
+    alignas(64) std::atomic<size_t> tail = 0;
+    size_t cached_head = 0;  // producer's last view of head
+    std::atomic<size_t> dropped_frames = 0;
+
+    alignas(64) std::atomic<size_t> head = 0;
+
+    alignas(64) double timestamps[kCapacity];
+    uint8_t frames[kCapacity][2];
+};
+
+}
+
+#endif
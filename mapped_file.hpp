@@ -0,0 +1,72 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifdef __unix__
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+
+namespace photometer {
+
+// Contents of a whole file, mapped where the system supports it, or else read into memory. A file
+// that cannot be read has no bytes.
+class MappedFile {
+public:
+    explicit MappedFile(const char *path) {
+#ifdef __unix__
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                ::madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const uint8_t *>(mapped);
+                bytes = st.st_size;
+                is_mapped = true;
+            }
+        }
+        ::close(fd);
+        if (is_mapped)
+            return;
+#endif
+        if (std::FILE *file = std::fopen(path, "rb")) {
+            uint8_t chunk[1 << 16];
+            for (size_t n; (n = std::fread(chunk, 1, sizeof chunk, file)) > 0;)
+                buffer.insert(buffer.end(), chunk, chunk + n);
+            std::fclose(file);
+            data = buffer.data();
+            bytes = buffer.size();
+        }
+    }
+
+    ~MappedFile() {
+#ifdef __unix__
+        if (is_mapped)
+            ::munmap(const_cast<uint8_t *>(data), bytes);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data = nullptr;
+    size_t bytes = 0;
+
+private:
+    bool is_mapped = false;
+    std::vector<uint8_t> buffer;
+};
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef NOTIFIER_HPP
+#define NOTIFIER_HPP
+
+#include "photometer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace photometer {
+
+// Effective bounds of a meter from some time on, as reported to subscribers
+struct BoundsChange {
+    double time;  // monotonic seconds
+    double lower, upper, estimate;
+};
+
+// The bounds of a meter as last reported, to tell which are changes worth reporting. Both
+// ChangeNotifier and frame_pipeline() report through one, so that they agree on what a change is.
+class BoundsTracker {
+public:
+    // Starts from the universal bounds, as reported at the beginning of time
+    explicit BoundsTracker(
+        double lower = universal_lower.value(), double upper = universal_upper.value()
+    ): last {
+        .time = -std::numeric_limits<double>::infinity(),
+        .lower = lower, .upper = upper, .estimate = 0.5*(lower + upper),
+    } { }
+
+    const BoundsChange &current() const { return last; }
+
+    // Whether the bounds of a meter as of now differ from the last reported, which they then are
+    template <typename Meter>
+    bool update(const Meter &meter, double now) {
+        const double lower = meter.lower(now), upper = meter.upper(now);
+        if (lower == last.lower && upper == last.upper)
+            return false;
+        last = BoundsChange {
+            .time = now, .lower = lower, .upper = upper, .estimate = 0.5*(lower + upper),
+        };
+        return true;
+    }
+
+private:
+    BoundsChange last;
+};
+
+// Wraps a meter to call subscribers back whenever its effective bounds change, so that they need
+// not poll estimate(). Bounds change when a frame is consumed and when a sample expires. Expiries
+// are reported once the clock passes them, either on the next consume() or on advance(), which
+// is meant to be called from a timer set for next_deadline(); either way each change is reported
+// with the time at which it took effect, in order.
+//
+// The meter must have next_change_time(now), as Photometer and PackedPhotometer do. If it also has
+// next_bounds_change(now), as Photometer does, the deadline is only ever the expiry of a sample
+// that can change the bounds, so that a steady light does not resolve them on every expiry; and
+// with next_bounds_change(sample, lower, upper) as well, a frame only resolves them if its sample
+// may change them, which in a steady light few do. The notifier puts a meter that has
+// set_incremental() in incremental mode, where Photometer answers that from its runs.
+// Callbacks run on the thread calling consume() or advance(), and must not subscribe or
+// unsubscribe.
+template <typename Meter = Photometer>
+class ChangeNotifier {
+public:
+    using Callback = std::function<void(const BoundsChange &)>;
+
+    ChangeNotifier() {
+        if constexpr (requires { meter_.set_incremental(true); })
+            meter_.set_incremental(true);
+    }
+
+    // Returns an id for unsubscribe()
+    size_t subscribe(Callback callback) {
+        subscribers.emplace_back(next_id, std::move(callback));
+        return next_id++;
+    }
+
+    void unsubscribe(size_t id) {
+        std::erase_if(subscribers, [id](const auto &subscriber) { return subscriber.first == id; });
+    }
+
+    const Meter &meter() const { return meter_; }
+
+    // The bounds as last reported
+    const BoundsChange &current() const { return tracker.current(); }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        // An expiry at now coincides with the frame, so it is reported with the frame's change
+        while (deadline < now)
+            expire();
+        meter_.consume(now, data);
+        // Until the frame may change the bounds, they stay as last reported
+        const double change = deadline == now? now: next_change(now, data);
+        if (change > now) {
+            deadline = std::min(deadline, change);
+            return;
+        }
+        check(now);
+        deadline = next_change(now);
+    }
+
+    // Reports every change from expiry up to and including now
+    void advance(
+        double now  // monotonic seconds
+    ) {
+        while (deadline <= now)
+            expire();
+    }
+
+    // When advance() next needs to be called; infinity if no sample will expire
+    double next_deadline() const { return deadline; }
+
+private:
+    double next_change(double now) const {
+        if constexpr (requires { meter_.next_bounds_change(now); })
+            return meter_.next_bounds_change(now);
+        else return meter_.next_change_time(now);
+    }
+
+    // When the frame just consumed may first change the bounds as last reported, before the
+    // deadline; now for a meter that cannot tell
+    double next_change(double now, const uint8_t (&data)[2]) const {
+        if constexpr (requires { meter_.next_bounds_change(Meter::Sample::from_raw(now, data), 0, 0); }) {
+            const BoundsChange &last = tracker.current();
+            return meter_.next_bounds_change(Meter::Sample::from_raw(now, data), last.lower, last.upper);
+        }
+        else return now;
+    }
+
+    void expire() {
+        check(deadline);
+        deadline = next_change(deadline);
+    }
+
+    void check(double now) {
+        if (!tracker.update(meter_, now))
+            return;
+        for (const auto &[id, callback]: subscribers)
+            callback(tracker.current());
+    }
+
+    Meter meter_;
+    double deadline = std::numeric_limits<double>::infinity();
+    BoundsTracker tracker;
+    std::vector<std::pair<size_t, Callback>> subscribers;
+    size_t next_id = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,2834 @@
+#ifndef PHOTOMETER_HPP
+#define PHOTOMETER_HPP
+
+#if __cplusplus < 202002L
+#   warning This program was written for compatibility with c++20 or later.
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+
+namespace photometer {
+
+// Integer clock for exact time arithmetic, counting ticks of kTickS seconds. Every horizon is a
+// whole number of ticks, and tick counts below 2^53 (about 28 years) are exact as doubles, so
+// that samples timed in ticks expire exactly on their boundaries.
+enum class Ticks : uint64_t {};
+
+inline constexpr double kTickS = 100e-9;
+
+// Which clock the times of a meter are on, fixed by the first frame it consumes, so that debug
+// builds catch a caller mixing seconds and ticks
+enum class ClockKind : uint8_t { unset, seconds, ticks };
+
+inline void latch_clock(ClockKind &clock, ClockKind kind) {
+    assert(clock == ClockKind::unset || clock == kind);
+    clock = kind;
+}
+
+// What the frame fields of one sensor model mean. A VAL code is kValueOffsetLx + kValueStepLx*VAL
+// lux, and an HRZ code is a horizon of kHorizonS*2^HRZ seconds, which is kHorizonTicks*2^HRZ
+// ticks. Every possible value lies strictly between kUniversalLowerLx and kUniversalUpperLx.
+// Policies for calibrated variants follow the same shape.
+struct DimbulbPolicy {
+    static constexpr double kValueOffsetLx = 50e3, kValueStepLx = 390;
+    static constexpr double kHorizonS = 0.0165;
+    static constexpr uint64_t kHorizonTicks = 165000;  // 16.5 ms
+    static constexpr double kUniversalLowerLx = 0, kUniversalUpperLx = 100e3;
+};
+
+// Quantities encoded by the frame fields, generated at compile time so that decoding is a load
+template <typename Policy>
+struct SensorTables {
+    static constexpr std::array<double, 256> kValueLx = [] {
+        std::array<double, 256> table;
+        for (int code = 0; code < 256; code++)
+            table[code] = Policy::kValueOffsetLx + Policy::kValueStepLx*static_cast<int8_t>(code);
+        return table;
+    }();
+
+    static constexpr std::array<double, 16> kHorizonS = [] {
+        std::array<double, 16> table;
+        for (unsigned code = 0; code < 16; code++)
+            table[code] = Policy::kHorizonS*(1u << code);
+        return table;
+    }();
+
+    static constexpr std::array<uint64_t, 16> kHorizonTicks = [] {
+        std::array<uint64_t, 16> table;
+        for (unsigned code = 0; code < 16; code++)
+            table[code] = Policy::kHorizonTicks << code;
+        return table;
+    }();
+};
+
+inline constexpr const std::array<double, 256> &kValueLx = SensorTables<DimbulbPolicy>::kValueLx;
+inline constexpr const std::array<double, 16> &kHorizonS = SensorTables<DimbulbPolicy>::kHorizonS;
+inline constexpr const std::array<uint64_t, 16> &kHorizonTicks =
+    SensorTables<DimbulbPolicy>::kHorizonTicks;
+
+struct RawSample {
+    uint16_t confidence: 2;
+    uint16_t clear: 1;
+    int16_t value: 8;
+    uint16_t sign: 1;
+    uint16_t horizon: 4;
+
+    // Frames are decoded and encoded with explicit shifts and masks rather than by copying their
+    // bytes, since the layout of the bitfields is implementation-defined
+    static constexpr RawSample from_bytes(
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        const uint16_t word = data[0] | data[1] << 8;
+        return RawSample {
+            .confidence = static_cast<uint16_t>(word & 0x3),
+            .clear = static_cast<uint16_t>(word >> 2 & 0x1),
+            .value = static_cast<int8_t>(word >> 3 & 0xff),
+            .sign = static_cast<uint16_t>(word >> 11 & 0x1),
+            .horizon = static_cast<uint16_t>(word >> 12),
+        };
+    }
+
+    constexpr std::array<uint8_t, 2> to_bytes() const {
+        const uint16_t word =
+            confidence | clear << 2 | (value & 0xff) << 3 | sign << 11 | horizon << 12;
+        return { static_cast<uint8_t>(word & 0xff), static_cast<uint8_t>(word >> 8) };
+    }
+
+    void dump() const {
+        const std::array<uint8_t, 2> bytes = to_bytes();
+        std::cout
+            << "meter.consume(now, (const uint8_t[2]){ "
+            << std::hex
+            << "0x" << static_cast<uint16_t>(bytes[0]) << "u, "
+            << "0x" << static_cast<uint16_t>(bytes[1]) << "u });  //"
+            << std::dec
+            << " conf=" << confidence
+            << " clear=" << clear
+            << " value=" << value_lx()
+            << " sign=" << sign
+            << " horizon=" << horizon_s()
+            << "\n";
+    }
+
+    template <typename Policy = DimbulbPolicy>
+    constexpr double value_lx() const {
+        return SensorTables<Policy>::kValueLx[value & 0xff];
+    }
+
+    template <typename Policy = DimbulbPolicy>
+    constexpr double horizon_s() const {
+        return SensorTables<Policy>::kHorizonS[horizon];
+    }
+
+    template <typename Policy = DimbulbPolicy>
+    constexpr uint64_t horizon_ticks() const {
+        return SensorTables<Policy>::kHorizonTicks[horizon];
+    }
+};
+
+// One bound, decoded from a frame with the constants of a sensor policy
+template <typename Policy>
+class BasicSample {
+private:
+    static constexpr size_t kBytes = 2;
+
+public:
+    static constexpr BasicSample from_raw(
+        double now,                    // monotonic seconds
+        const uint8_t (&data)[kBytes]  // raw from the sensor
+    ) {
+        return BasicSample(now, RawSample::from_bytes(data));
+    }
+
+    // Timed in ticks rather than seconds, with an exact end
+    static constexpr BasicSample from_raw(
+        Ticks now,
+        const uint8_t (&data)[kBytes]  // raw from the sensor
+    ) {
+        const RawSample raw = RawSample::from_bytes(data);
+        return BasicSample(
+            static_cast<double>(now),
+            static_cast<double>(
+                static_cast<uint64_t>(now) + SensorTables<Policy>::kHorizonTicks[raw.horizon]
+            ),
+            raw.sign, SensorTables<Policy>::kValueLx[raw.value & 0xff], raw.clear, raw.confidence
+        );
+    }
+
+    constexpr BasicSample(
+        double now,           // monotonic seconds
+        const RawSample &raw  // raw from the sensor
+    ):
+        start_(now),
+        end_(now + SensorTables<Policy>::kHorizonS[raw.horizon]),
+        sign_(raw.sign),
+        value_(SensorTables<Policy>::kValueLx[raw.value & 0xff]),
+        clear_(raw.clear),
+        confidence_(raw.confidence)
+    { }
+
+    // The frame it was decoded from, given the clock it was timed on
+    constexpr RawSample raw(ClockKind clock = ClockKind::seconds) const {
+        const double horizon = clock == ClockKind::ticks
+            ? static_cast<double>(Policy::kHorizonTicks): Policy::kHorizonS;
+        return RawSample {
+            .confidence = confidence_,
+            .clear = clear_,
+            .value = static_cast<int16_t>((value_ - Policy::kValueOffsetLx)/Policy::kValueStepLx),
+            .sign = sign_,
+            .horizon = static_cast<uint16_t>(std::round(
+                std::log((end_ - start_)/horizon)/std::log(2.)
+            )),
+        };
+    }
+
+    constexpr BasicSample(bool universal_sign):
+        start_(std::numeric_limits<double>::lowest()),
+        end_(std::numeric_limits<double>::max()),
+        sign_(universal_sign),
+        // If sign is 1, this sample's value is greater than all possible values
+        // If sign is 0, this sample's value is lower than all possible values
+        value_(universal_sign? Policy::kUniversalUpperLx: Policy::kUniversalLowerLx),
+        clear_(false),
+        confidence_(0)
+    { }
+
+    constexpr BasicSample(
+        double start, double end, bool sign, double value, bool clear, uint8_t confidence
+    ):
+        start_(start), end_(end), sign_(sign), value_(value), clear_(clear), confidence_(confidence)
+    { }
+
+    constexpr double start() const { return start_; }
+    constexpr double end() const { return end_; }
+    constexpr bool should_clear() const { return clear_; }
+    constexpr double value() const { return value_; }
+    constexpr bool sign() const { return sign_; }
+    constexpr uint8_t confidence() const { return confidence_; }
+
+    constexpr bool conflicts(const BasicSample &other) const {
+        return
+            (
+                // gt           lt
+                sign_ && !other.sign_ &&
+                value_ < other.value_
+            ) ||
+            (
+                // lt           gt
+                !sign_ && other.sign_ &&
+                value_ > other.value_
+            );
+    }
+
+    constexpr bool is_superset_of(const BasicSample &other) const {
+        return end_ >= other.end_
+            && (
+                // upper bound superset
+                (sign_ && other.sign_ && value_ <= other.value_) ||
+                // lower bound superset
+                (!sign_ && !other.sign_ && value_ >= other.value_)
+            );
+    }
+
+    constexpr bool overrides(const BasicSample &other) const {
+        if (conflicts(other)) {
+            return confidence_ > other.confidence_
+                || (confidence_ == other.confidence_ && start_ < other.start_);
+        }
+        else return false;
+    }
+
+    constexpr const BasicSample &resolve_lower(const BasicSample &other) const {
+        // Only narrow the range by preferring the greater lower bound
+        return value_ > other.value_? *this: other;
+    }
+
+    constexpr const BasicSample &resolve_upper(const BasicSample &other) const {
+        // Only narrow the range by preferring the lesser upper bound
+        return value_ < other.value_? *this: other;
+    }
+
+private:
+    double start_, end_;
+    bool sign_;
+    double value_;
+    bool clear_;
+    uint8_t confidence_;
+};
+
+using Sample = BasicSample<DimbulbPolicy>;
+
+inline constexpr Sample universal_lower(false), universal_upper(true);
+
+
+// A block of frames decoded field by field into arrays. Every loop runs over the full, fixed
+// capacity with only shifts, masks and conversions, so that compilers vectorise them; the
+// arithmetic matches SensorTables, so the samples are identical to BasicSample::from_raw().
+struct FrameBlock {
+    static constexpr size_t kCapacity = 256;
+
+    template <typename Policy = DimbulbPolicy>
+    void decode(
+        const double *timestamps,      // monotonic seconds
+        const uint8_t (*frames)[2],    // raw from the sensor
+        size_t n                       // at most kCapacity
+    ) {
+        assert(n <= kCapacity);
+        count = n;
+        uint16_t words[kCapacity] = {};
+        double now[kCapacity] = {};
+        for (size_t i = 0; i < n; i++) {
+            words[i] = frames[i][0] | frames[i][1] << 8;
+            now[i] = timestamps[i];
+        }
+
+        for (size_t i = 0; i < kCapacity; i++) {
+            confidence[i] = words[i] & 0x3;
+            clear[i] = words[i] >> 2 & 0x1;
+            sign[i] = words[i] >> 11 & 0x1;
+        }
+        for (size_t i = 0; i < kCapacity; i++)
+            value[i] = Policy::kValueOffsetLx
+                + Policy::kValueStepLx*static_cast<int8_t>(words[i] >> 3 & 0xff);
+        for (size_t i = 0; i < kCapacity; i++) {
+            start[i] = now[i];
+            end[i] = now[i] + Policy::kHorizonS*(1u << (words[i] >> 12));
+        }
+    }
+
+    template <typename Sample = photometer::Sample>
+    constexpr Sample sample(size_t i) const {
+        return Sample(start[i], end[i], sign[i], value[i], clear[i], confidence[i]);
+    }
+
+    size_t count = 0;
+    uint8_t confidence[kCapacity], clear[kCapacity], sign[kCapacity];
+    double value[kCapacity], start[kCapacity], end[kCapacity];
+};
+
+
+// Index over samples of one sign that answers whether any of them overrides a given sample of the
+// opposite sign in O(log n), instead of checking every pair with Sample::overrides().
+//
+// A sample is overridden by any conflicting sample with a greater confidence, or by a conflicting
+// sample with the same confidence that started earlier. Conflicts only depend on value order, so
+// the indexed samples are sorted by (confidence, start) and each entry records the most extreme
+// value of its confidence group up to itself, and of every entry from itself to the end.
+class OverrideIndex {
+public:
+    explicit OverrideIndex(std::pmr::memory_resource *resource = std::pmr::get_default_resource()):
+        entries(resource)
+    { }
+
+    void clear(bool sign) {
+        sign_ = sign;
+        entries.clear();
+    }
+
+    template <typename Sample>
+    void add(const Sample &sample) {
+        assert(sample.sign() == sign_);
+        entries.push_back(Entry {
+            .confidence = sample.confidence(),
+            .start = sample.start(),
+            .key = key(sample),
+        });
+    }
+
+    // Must be called after the last add() and before the first query
+    void finish() {
+        std::sort(
+            entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+                return a.confidence < b.confidence
+                    || (a.confidence == b.confidence && a.start < b.start);
+            }
+        );
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            Entry &entry = entries[i];
+            entry.group_min = entry.key;
+            if (i > 0 && entries[i - 1].confidence == entry.confidence)
+                entry.group_min = std::min(entry.group_min, entries[i - 1].group_min);
+        }
+
+        for (size_t i = entries.size(); i-- > 0;) {
+            Entry &entry = entries[i];
+            entry.suffix_min = entry.key;
+            if (i + 1 < entries.size())
+                entry.suffix_min = std::min(entry.suffix_min, entries[i + 1].suffix_min);
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // Equivalent to testing indexed.overrides(other) for every indexed sample
+    template <typename Sample>
+    bool overrides(const Sample &other) const {
+        if (other.sign() == sign_)
+            return false;
+        const double other_key = key(other);
+
+        // Any conflicting sample with a greater confidence
+        std::pmr::vector<Entry>::const_iterator above = std::partition_point(
+            entries.cbegin(), entries.cend(),
+            [&other](const Entry &entry) { return entry.confidence <= other.confidence(); }
+        );
+        if (above != entries.cend() && above->suffix_min < other_key)
+            return true;
+
+        // Any conflicting sample with the same confidence that started earlier
+        std::pmr::vector<Entry>::const_iterator later = std::partition_point(
+            entries.cbegin(), above,
+            [&other](const Entry &entry) {
+                return entry.confidence < other.confidence()
+                    || (entry.confidence == other.confidence() && entry.start < other.start());
+            }
+        );
+        if (later != entries.cbegin()) {
+            const Entry &earlier = *(later - 1);
+            if (earlier.confidence == other.confidence() && earlier.group_min < other_key)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    struct Entry {
+        uint8_t confidence;
+        double start;
+        double key, group_min, suffix_min;
+    };
+
+    // Maps values so that an indexed sample conflicts with another if and only if its key is less
+    // than the other's: upper bounds conflict with greater lower bounds, and vice versa.
+    template <typename Sample>
+    constexpr double key(const Sample &sample) const {
+        return sign_? sample.value(): -sample.value();
+    }
+
+    bool sign_ = false;
+    std::pmr::vector<Entry> entries;
+};
+
+// Scratch space that the const calls of its owner borrow, one at a time, so as to reuse its
+// capacity between calls. A call that finds it lent out makes one of its own rather than wait, so
+// concurrent calls stay safe. T is constructed from the resource to allocate from, which copies
+// keep; neither copies nor assignments carry the contents over.
+template <typename T>
+class Lendable {
+public:
+    explicit Lendable(std::pmr::memory_resource *resource = std::pmr::get_default_resource()):
+        resource(resource), object(resource)
+    { }
+
+    Lendable(const Lendable &other): Lendable(other.resource) { }
+    Lendable &operator=(const Lendable &) { return *this; }
+
+    // Holds the object, or a new one if it was lent out, until destroyed
+    class Lease {
+    public:
+        explicit Lease(const Lendable &lendable):
+            lendable(lendable), taken(!lendable.busy.test_and_set(std::memory_order_acquire))
+        {
+            if (!taken)
+                spare.emplace(lendable.resource);
+        }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        ~Lease() {
+            if (taken)
+                lendable.busy.clear(std::memory_order_release);
+        }
+
+        T &operator*() { return taken? lendable.object: *spare; }
+
+    private:
+        const Lendable &lendable;
+        bool taken;
+        std::optional<T> spare;
+    };
+
+private:
+    std::pmr::memory_resource *resource;
+    mutable T object;
+    mutable std::atomic_flag busy;
+};
+
+
+// Fenwick tree over ranks that answers the greatest value recorded at any rank below a bound in
+// O(log n); values only ever increase
+class PrefixMax {
+public:
+    explicit PrefixMax(std::pmr::memory_resource *resource = std::pmr::get_default_resource()):
+        tree(resource)
+    { }
+
+    void reset(size_t ranks) {
+        tree.assign(ranks + 1, -std::numeric_limits<double>::infinity());
+    }
+
+    void record(size_t rank, double value) {
+        for (size_t i = rank + 1; i < tree.size(); i += i & -i)
+            tree[i] = std::max(tree[i], value);
+    }
+
+    // Greatest value recorded at ranks [0, rank), or -infinity for none
+    double below(size_t rank) const {
+        double best = -std::numeric_limits<double>::infinity();
+        for (size_t i = rank; i > 0; i -= i & -i)
+            best = std::max(best, tree[i]);
+        return best;
+    }
+
+private:
+    std::pmr::vector<double> tree;
+};
+
+
+// Counts of call latencies in power-of-two buckets of nanoseconds: bucket b counts latencies in
+// [2^b, 2^(b+1)), except that bucket 0 also counts 0 and the last bucket has no upper limit
+struct LatencyHistogram {
+    static constexpr size_t kBuckets = 32;
+
+    void record(uint64_t ns) {
+        counts[std::min<size_t>(kBuckets - 1, ns? std::bit_width(ns) - 1: 0)]++;
+    }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t count: counts)
+            sum += count;
+        return sum;
+    }
+
+    // Upper limit of the bucket that holds the given quantile, in nanoseconds; 0 if empty
+    uint64_t quantile_ns(double q) const {
+        const uint64_t n = total();
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; b++) {
+            seen += counts[b];
+            if (n && seen >= q*n)
+                return b + 1 < kBuckets? uint64_t(1) << (b + 1): UINT64_MAX;
+        }
+        return 0;
+    }
+
+    uint64_t counts[kBuckets] = {};
+};
+
+struct PhotometerStats {
+    uint64_t frames = 0,      // consumed, singly or in batches
+             clears = 0,      // frames with CLR set
+             rejected = 0,    // samples dropped on arrival as subsets of a stored sample
+             expired = 0,     // samples erased once their horizon passed
+             overridden = 0,  // samples found to be overridden while resolving a bound
+             resolutions = 0, // bounds resolved as of a time rather than served from the cache
+             sweeps = 0;      // effective spans of every sample found, for next_bounds_change()
+    size_t peak_size = 0;
+    LatencyHistogram consume_ns, estimate_ns;
+};
+
+// Stats for a meter that keeps none, so that none of the counting or timing is compiled
+struct NoStats { };
+
+// Records the lifetime of a scope into a histogram of the stats, if the meter keeps any
+template <typename Stats>
+class LatencyTimer {
+public:
+    LatencyTimer(Stats &, LatencyHistogram PhotometerStats::*) { }
+};
+
+template <>
+class LatencyTimer<PhotometerStats> {
+public:
+    LatencyTimer(PhotometerStats &stats, LatencyHistogram PhotometerStats::*histogram):
+        histogram(stats.*histogram), start(std::chrono::steady_clock::now())
+    { }
+
+    ~LatencyTimer() {
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count());
+    }
+
+private:
+    LatencyHistogram &histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+// Checkpoint of the samples of a Photometer valid at some reference time, from which a meter can
+// be restored after a restart without waiting for frames to converge:
+//
+//   offset  size    field
+//   0       8       magic, "DIMBCKP" and a format version byte
+//   8       4       sample count n, unsigned
+//   12      4       FNV-1a hash of everything from offset 16, to reject torn or corrupted writes
+//   16      1       ClockKind of the sample times, seconds or ticks
+//   17      3       zero
+//   20      6n      samples of either sign in order of end, each as the frame it came from and
+//                   its start relative to the reference, in whole microseconds on either clock,
+//                   signed (4 bytes)
+//
+// All fields are little-endian. Samples are re-decoded from their frames on restore, on the clock
+// the checkpoint was written on, which the meter restoring it must also be on.
+namespace checkpoint {
+
+inline constexpr uint8_t kMagic[8] = { 'D', 'I', 'M', 'B', 'C', 'K', 'P', 2 };
+inline constexpr size_t kHeaderBytes = 20, kHashedFrom = 16, kSampleBytes = 6;
+
+// Ticks or seconds per microsecond of a start offset
+inline constexpr double unit(ClockKind clock) { return clock == ClockKind::ticks? 10: 1e-6; }
+
+inline void put_u32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        out[i] = value >> 8*i & 0xff;
+}
+
+inline uint32_t get_u32(const uint8_t *in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= uint32_t(in[i]) << 8*i;
+    return value;
+}
+
+inline uint32_t hash(const uint8_t *data, size_t bytes) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bytes; i++)
+        hash = (hash ^ data[i])*16777619u;
+    return hash;
+}
+
+}
+
+// The reference meter, decoding frames with the constants of a sensor policy. With PhotometerStats
+// for Stats, it also counts what it does and times its calls, for stats().
+template <typename Policy, typename Stats = NoStats>
+class BasicPhotometer {
+public:
+    using Sample = BasicSample<Policy>;
+    static constexpr bool kKeepsStats = std::is_same_v<Stats, PhotometerStats>;
+
+    static constexpr Sample universal_lower{false}, universal_upper{true};
+
+    class Workspace;
+
+    BasicPhotometer(): BasicPhotometer(std::pmr::get_default_resource()) { }
+
+    // Everything the meter allocates, including the scratch space of its estimates, comes from
+    // the resource, which must outlive it. As with std::pmr containers, a move keeps the
+    // resource, and a copy or assignment does not carry it over: copies use the default resource
+    // unless given one, and an assigned meter keeps its own.
+    explicit BasicPhotometer(std::pmr::memory_resource *resource):
+        lower_by_end(resource), upper_by_end(resource),
+        lower_frontier(resource), upper_frontier(resource),
+        runs {
+            { RunsT(resource), RunsT(resource), RunsT(resource), RunsT(resource) },
+            { RunsT(resource), RunsT(resource), RunsT(resource), RunsT(resource) },
+        },
+        own_workspace(resource)
+    { }
+
+    BasicPhotometer(
+        const BasicPhotometer &current, double future,
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource()
+    ): BasicPhotometer(resource) {
+        lower_by_end.insert(
+            current.lower_by_end.upper_bound(std::max(future, current.expired_until)),
+            current.lower_by_end.cend()
+        );
+        upper_by_end.insert(
+            current.upper_by_end.upper_bound(std::max(future, current.expired_until)),
+            current.upper_by_end.cend()
+        );
+        expiry_budget = current.expiry_budget;
+        clock = current.clock;
+        incremental = current.incremental;
+        rebuild_frontiers();
+    }
+
+    // The frontiers refer into the maps, so copies rebuild their own
+    BasicPhotometer(const BasicPhotometer &other):
+        BasicPhotometer(other, std::pmr::get_default_resource())
+    { }
+
+    BasicPhotometer(const BasicPhotometer &other, std::pmr::memory_resource *resource):
+        BasicPhotometer(resource)
+    {
+        lower_by_end = other.lower_by_end;
+        upper_by_end = other.upper_by_end;
+        expired_until = other.expired_until;
+        expiry_budget = other.expiry_budget;
+        clock = other.clock;
+        incremental = other.incremental;
+        latest = other.latest;
+        stats_ = other.stats_;
+        rebuild_frontiers();
+    }
+
+    BasicPhotometer(BasicPhotometer &&) = default;
+
+    BasicPhotometer &operator=(BasicPhotometer other) {
+        version.renew();
+        expired_until = other.expired_until;
+        expiry_budget = other.expiry_budget;
+        clock = other.clock;
+        incremental = other.incremental;
+        latest = other.latest;
+        stats_ = other.stats_;
+        if (resource() == other.resource()) {
+            lower_by_end.swap(other.lower_by_end);
+            upper_by_end.swap(other.upper_by_end);
+            lower_frontier.swap(other.lower_frontier);
+            upper_frontier.swap(other.upper_frontier);
+            std::swap(runs, other.runs);
+            next_run_expiry = other.next_run_expiry;
+        }
+        else {
+            // Containers with different resources cannot swap, so the samples are moved into
+            // this meter's resource and the rest rebuilt there
+            lower_by_end = std::move(other.lower_by_end);
+            upper_by_end = std::move(other.upper_by_end);
+            rebuild_frontiers();
+        }
+        return *this;
+    }
+
+    std::pmr::memory_resource *resource() const { return lower_by_end.get_allocator().resource(); }
+
+    // Number of samples stored, including expired ones not yet reclaimed
+    size_t size() const { return lower_by_end.size() + upper_by_end.size(); }
+
+    // Limits how many expired samples one consume() may reclaim, so that its latency does not
+    // depend on how many expire at once; the rest are reclaimed by later calls. Batches may
+    // reclaim as many per frame they carry, so that the backlog stays bounded however frames
+    // are consumed. Expired samples are ignored whether or not they have been reclaimed, so
+    // estimates do not depend on this.
+    void set_expiry_budget(
+        size_t samples  // per call; at least 1
+    ) {
+        assert(samples > 0);
+        expiry_budget = samples;
+    }
+
+    // In incremental mode, the meter also keeps the samples of each sign and confidence by value,
+    // in O(log n) per sample, and resolves bounds by walking the values of the 4x2 of those from
+    // the tightest, instead of indexing and checking every sample; see resolve_runs(). Estimates
+    // and resolutions do not depend on the mode.
+    void set_incremental(bool on) {
+        incremental = on;
+        rebuild_frontiers();
+    }
+
+    const PhotometerStats &stats() const requires kKeepsStats { return stats_; }
+    void reset_stats() requires kKeepsStats { stats_ = PhotometerStats(); }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        latch_clock(clock, ClockKind::seconds);
+        consume(Sample::from_raw(now, data));
+    }
+
+    // Same, with an integer clock. A meter must keep to one clock: once it consumes ticks, its
+    // sample times are in ticks, and so must be the times of its estimates.
+    void consume(
+        Ticks now,
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        latch_clock(clock, ClockKind::ticks);
+        consume(Sample::from_raw(now, data));
+    }
+
+    void consume(const Sample &sample) {
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::consume_ns);
+        tally(&PhotometerStats::frames);
+        changed(sample.start());
+        if (sample.should_clear()) {
+            tally(&PhotometerStats::clears);
+            clear();
+        }
+        else erase_old(sample.start());
+        insert(sample);
+    }
+
+    // Same as consuming each frame in turn
+    void consume_batch(
+        const double *timestamps,    // monotonic seconds
+        const uint8_t (*frames)[2],  // raw from the sensor
+        size_t count
+    ) {
+        if (count == 0)
+            return;
+        latch_clock(clock, ClockKind::seconds);
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::consume_ns);
+        if constexpr (kKeepsStats) {
+            stats_.frames += count;
+            for (size_t i = 0; i < count; i++)
+                stats_.clears += frames[i][0] >> 2 & 0x1;
+        }
+        changed(timestamps[count - 1]);
+
+        // Everything before the last CLR would be discarded by it
+        size_t first = count;
+        while (first > 0 && !(frames[first - 1][0] & 0x4))
+            first--;
+        if (first > 0) {
+            first--;
+            clear();
+        }
+
+        // Expiry only needs to run once at the end. Samples that would already have expired end
+        // before any sample being inserted, so they cannot be its supersets, and inserting either
+        // discards them along with the other samples that it covers or leaves them for expiry.
+        FrameBlock block;
+        for (size_t i = first; i < count; i += FrameBlock::kCapacity) {
+            block.decode<Policy>(timestamps + i, frames + i, std::min(count - i, FrameBlock::kCapacity));
+            for (size_t j = 0; j < block.count; j++)
+                insert(block.sample<Sample>(j));
+        }
+        erase_old(timestamps[count - 1], count);
+    }
+
+    // Same, from frames that the caller has already decoded with this meter's policy, so that
+    // decoding can be done ahead of time, as FramePipeline does
+    void consume_block(const FrameBlock &block) {
+        if (block.count == 0)
+            return;
+        latch_clock(clock, ClockKind::seconds);
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::consume_ns);
+        if constexpr (kKeepsStats) {
+            stats_.frames += block.count;
+            for (size_t i = 0; i < block.count; i++)
+                stats_.clears += block.clear[i];
+        }
+        const double last = block.start[block.count - 1];
+        changed(last);
+
+        size_t first = block.count;
+        while (first > 0 && !block.clear[first - 1])
+            first--;
+        if (first > 0) {
+            first--;
+            clear();
+        }
+        for (size_t i = first; i < block.count; i++)
+            insert(block.sample<Sample>(i));
+        erase_old(last, block.count);
+    }
+
+    // Const calls are safe to make concurrently. Those given no Workspace borrow the meter's own,
+    // or make one if another call has it.
+    double lower() const { return lower(all(), *Lease(own_workspace)).value(); }
+    double upper() const { return upper(all(), *Lease(own_workspace)).value(); }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        return lower(now, *Lease(own_workspace));
+    }
+
+    double lower(double now, Workspace &workspace) const {
+        return bounds_as_of(now, workspace).lower;
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        return upper(now, *Lease(own_workspace));
+    }
+
+    double upper(double now, Workspace &workspace) const {
+        return bounds_as_of(now, workspace).upper;
+    }
+
+    // No 'now'; all samples considered current
+    double estimate() const {
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::estimate_ns);
+        Lease lease(own_workspace);
+        return 0.5*(lower(all(), *lease).value() + upper(all(), *lease).value());
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return estimate(now, *Lease(own_workspace));
+    }
+
+    double estimate(double now, Workspace &workspace) const {
+        const Bounds &bounds = bounds_as_of(now, workspace);
+        return 0.5*(bounds.lower + bounds.upper);
+    }
+
+    double lower(Ticks now) const { return lower(in_ticks(now)); }
+    double upper(Ticks now) const { return upper(in_ticks(now)); }
+    double estimate(Ticks now) const { return estimate(in_ticks(now)); }
+
+    // Both effective bounds, the estimate and where the bounds came from, from one evaluation
+    struct Resolution {
+        double lower, upper, midpoint;
+        // Of the samples giving each bound, with a bound of the same value that ends later taking
+        // precedence; 0 and infinity for the universal bounds
+        uint8_t lower_confidence, upper_confidence;
+        double lower_end, upper_end;
+
+        // Negative if conflicting bounds that neither overrides both take effect
+        double width() const { return upper - lower; }
+    };
+
+    // No 'now'; all samples considered current
+    Resolution resolve() const {
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::estimate_ns);
+        Bounds bounds;
+        resolve(all(), bounds, *Lease(own_workspace));
+        return resolution(bounds);
+    }
+
+    Resolution resolve(
+        double now  // monotonic seconds
+    ) const {
+        return resolve(now, *Lease(own_workspace));
+    }
+
+    Resolution resolve(double now, Workspace &workspace) const {
+        return resolution(bounds_as_of(now, workspace));
+    }
+
+    Resolution resolve(Ticks now) const { return resolve(in_ticks(now)); }
+
+    // Number of points in a series from t0 to t1 inclusive, at t0 + i*step
+    static size_t series_size(double t0, double t1, double step) {
+        assert(step > 0);
+        size_t n = 0;
+        while (t0 + n*step <= t1)
+            n++;
+        return n;
+    }
+
+    // Same as estimate(t) at every point of a series, into out[series_size(t0, t1, step)], but in
+    // one sweep over the samples rather than a full resolution per point.
+    //
+    // Overriding only depends on the pair of samples, so each sample takes effect from the latest
+    // end of the samples that override it (its kill time) until its own end. The kill times come
+    // from one pass in descending precedence, and the series from one pass in time order with a
+    // heap of the samples in effect for each sign.
+    size_t estimate_series(
+        double t0, double t1,  // monotonic seconds
+        double step,
+        double *out
+    ) const {
+        const size_t n = series_size(t0, t1, step);
+        estimate_series(t0, step, n, out);
+        return n;
+    }
+
+    // Same, for a given number of points n from t0, into out[n]
+    void estimate_series(
+        double t0,  // monotonic seconds
+        double step,
+        size_t n,
+        double *out
+    ) const {
+        if (n == 0)
+            return;
+
+        Lease lease(own_workspace);
+        Workspace &workspace = effective_spans(*lease);
+        std::pmr::vector<Span> &lowers = workspace.lowers, &uppers = workspace.uppers;
+        const auto by_from = [](const Span &a, const Span &b) { return a.from < b.from; };
+        std::sort(lowers.begin(), lowers.end(), by_from);
+        std::sort(uppers.begin(), uppers.end(), by_from);
+
+        // Heaps of the spans started so far, with the ended ones dropped lazily from the top
+        const auto lower_heap = [](const Span &a, const Span &b) { return a.value < b.value; };
+        const auto upper_heap = [](const Span &a, const Span &b) { return a.value > b.value; };
+        std::pmr::vector<Span> lower_active(resource()), upper_active(resource());
+        size_t next_lower = 0, next_upper = 0;
+        for (size_t i = 0; i < n; i++) {
+            const double now = t0 + i*step;
+            for (; next_lower < lowers.size() && lowers[next_lower].from <= now; next_lower++) {
+                lower_active.push_back(lowers[next_lower]);
+                std::push_heap(lower_active.begin(), lower_active.end(), lower_heap);
+            }
+            for (; next_upper < uppers.size() && uppers[next_upper].from <= now; next_upper++) {
+                upper_active.push_back(uppers[next_upper]);
+                std::push_heap(upper_active.begin(), upper_active.end(), upper_heap);
+            }
+            while (!lower_active.empty() && lower_active.front().until <= now) {
+                std::pop_heap(lower_active.begin(), lower_active.end(), lower_heap);
+                lower_active.pop_back();
+            }
+            while (!upper_active.empty() && upper_active.front().until <= now) {
+                std::pop_heap(upper_active.begin(), upper_active.end(), upper_heap);
+                upper_active.pop_back();
+            }
+
+            const double
+                lower = lower_active.empty()? universal_lower.value(): std::max(
+                    universal_lower.value(), lower_active.front().value
+                ),
+                upper = upper_active.empty()? universal_upper.value(): std::min(
+                    universal_upper.value(), upper_active.front().value
+                );
+            out[i] = 0.5*(lower + upper);
+        }
+    }
+
+    // Same, resuming from the bounds cached in a workspace, for a caller that interleaves short
+    // series with consumes, such as one replaying frames between which to estimate: the sweep
+    // above starts over on each call, but here points cost nothing while the cached bounds hold,
+    // and only crossing a frame or an expiry resolves them again. In incremental mode that walks
+    // the runs kept across consumes rather than sorting every sample.
+    void estimate_series(
+        double t0,  // monotonic seconds
+        double step,
+        size_t n,
+        double *out,
+        Workspace &workspace
+    ) const {
+        for (size_t i = 0; i < n; i++) {
+            const Bounds &bounds = bounds_as_of(t0 + i*step, workspace);
+            out[i] = 0.5*(bounds.lower + bounds.upper);
+        }
+    }
+
+    // Effective bounds over the times from one sample end to the next, during which the set of
+    // valid samples and hence the estimate cannot change
+    struct Bounds {
+        double from = kNever, until = -kNever;  // half-open interval, initially empty
+        double lower, upper;
+        // Of the samples giving each bound, as in Resolution
+        uint8_t lower_confidence, upper_confidence;
+        double lower_end, upper_end;
+    };
+
+private:
+    // Times over which a sample's bound is in effect, from its kill time until its end
+    struct Span {
+        double from, until, value;
+    };
+
+public:
+    // Scratch space for resolving bounds, and the last bounds resolved with it, so that estimates
+    // made with it between the same frames and expiries are served from that cache. A caller that
+    // makes estimates from several threads can keep one per thread, to skip what borrowing the
+    // meter's own would cost when another thread has it. Using one with any other meter, or after
+    // its meter has changed, only misses the cache.
+    class Workspace {
+    public:
+        explicit Workspace(std::pmr::memory_resource *resource = std::pmr::get_default_resource()):
+            index(resource), rivals(resource),
+            samples(resource), values(resource), upper_ends(resource), lower_ends(resource),
+            lowers(resource), uppers(resource)
+        { }
+
+    private:
+        friend class BasicPhotometer;
+
+        struct Rival {
+            double value, oldest;
+        };
+
+        uint64_t version = 0;  // of the meter the cache was resolved from; no meter has 0
+        Bounds cache;
+        OverrideIndex index;               // for lower() and upper()
+        std::pmr::vector<Rival> rivals;    // for resolve_runs()
+        // for effective_spans(), which leaves its spans in lowers and uppers
+        std::pmr::vector<const Sample *> samples;
+        std::pmr::vector<double> values;
+        PrefixMax upper_ends, lower_ends;
+        std::pmr::vector<Span> lowers, uppers;
+    };
+
+    Bounds bounds_as_of(
+        double now  // monotonic seconds
+    ) const {
+        return bounds_as_of(now, *Lease(own_workspace));
+    }
+
+    // As cached in the workspace, until it is next used
+    const Bounds &bounds_as_of(double now, Workspace &workspace) const {
+        const LatencyTimer<Stats> timer(stats_, &PhotometerStats::estimate_ns);
+        Bounds &cache = workspace.cache;
+        if (workspace.version == version.id() && now >= cache.from && now < cache.until)
+            return cache;
+        tally(&PhotometerStats::resolutions);
+        workspace.version = version.id();
+
+        const AsOf view = as_of(now);
+        cache.from = -kNever;
+        if (view.lower_begin != lower_by_end.cbegin())
+            cache.from = std::max(cache.from, std::prev(view.lower_begin)->first);
+        if (view.upper_begin != upper_by_end.cbegin())
+            cache.from = std::max(cache.from, std::prev(view.upper_begin)->first);
+        cache.until = kNever;
+        if (view.lower_begin != lower_by_end.cend())
+            cache.until = std::min(cache.until, view.lower_begin->first);
+        if (view.upper_begin != upper_by_end.cend())
+            cache.until = std::min(cache.until, view.upper_begin->first);
+        if (incremental) {
+            const double t = std::max(now, expired_until);
+            resolve_runs(false, t, cache.lower, cache.lower_confidence, cache.lower_end, workspace);
+            resolve_runs(true, t, cache.upper, cache.upper_confidence, cache.upper_end, workspace);
+        }
+        else resolve(view, cache, workspace);
+        return cache;
+    }
+
+    // Appends a checkpoint of the samples valid as of now to out, with times relative to now, and
+    // the clock they are on. It takes checkpoint::kHeaderBytes plus checkpoint::kSampleBytes per
+    // sample.
+    void checkpoint(
+        double now,  // monotonic seconds
+        std::vector<uint8_t> &out
+    ) const {
+        assert(clock != ClockKind::ticks);
+        checkpoint(ClockKind::seconds, now, out);
+    }
+
+    void checkpoint(Ticks now, std::vector<uint8_t> &out) const {
+        checkpoint(ClockKind::ticks, in_ticks(now), out);
+    }
+
+    // Replaces the samples with those of a checkpoint, taking now as its reference time; to
+    // account for time spent down, pass the time on this meter's clock at which it was written.
+    // If the bytes are not exactly one well-formed checkpoint on the same clock as now, returns
+    // false and changes nothing.
+    bool restore(
+        double now,  // monotonic seconds
+        const uint8_t *data,
+        size_t bytes
+    ) {
+        return restore(ClockKind::seconds, now, data, bytes);
+    }
+
+    bool restore(Ticks now, const uint8_t *data, size_t bytes) {
+        return restore(ClockKind::ticks, static_cast<double>(now), data, bytes);
+    }
+
+    // Earliest time after the latest consume() at which a sample expires, and so the estimate may
+    // change; infinity if none will
+    double next_change_time() const {
+        return next_change_time(latest);
+    }
+
+    // Earliest time after now at which a sample expires; infinity if none will
+    double next_change_time(
+        double now  // monotonic seconds
+    ) const {
+        const AsOf view = as_of(now);
+        return std::min(
+            view.lower_begin == lower_by_end.cend()? kNever: view.lower_begin->first,
+            view.upper_begin == upper_by_end.cend()? kNever: view.upper_begin->first
+        );
+    }
+
+    // Earliest time after now at which the effective bounds can change unless a frame arrives:
+    // when the last of the samples giving a bound expires, or when a tighter sample outlives the
+    // samples overriding it; infinity if neither will happen. Unlike next_change_time(), this
+    // skips the expiries of samples that are overridden or looser than the bounds, for the cost
+    // of one sweep over the samples, as in estimate_series().
+    double next_bounds_change(
+        double now  // monotonic seconds
+    ) const {
+        tally(&PhotometerStats::sweeps);
+        now = std::max(now, expired_until);
+        Lease lease(own_workspace);
+        const Workspace &workspace = effective_spans(*lease);
+        return std::min(
+            next_bounds_change(false, workspace.lowers, now),
+            next_bounds_change(true, workspace.uppers, now)
+        );
+    }
+
+    // For the sample of the frame consumed last, and the bounds as of just before it, the earliest
+    // time at which that sample may change the bounds before they would next have changed without
+    // it: its start if it may have changed them already, or infinity. It may only if it clears the
+    // others, if it is tighter than the bound of its sign, taking effect once the samples that
+    // override it expire, or if it conflicts with the opposite bound and overrides a sample of
+    // its value, which matters once no sample it does not override keeps that bound in effect.
+    // This takes the runs of incremental mode, with a few lookups rather than a sweep; otherwise
+    // it is always the start.
+    double next_bounds_change(const Sample &sample, double lower, double upper) const {
+        const double now = sample.start();
+        if (!incremental || sample.should_clear())
+            return now;
+        const bool sign = sample.sign();
+        const auto tighter = [sign](double a, double b) { return sign? a < b: a > b; };
+
+        double change = kNever;
+        if (tighter(sample.value(), sign? upper: lower)) {
+            const double from = overridden_until(sign, sample.confidence(), sample.value(), now);
+            if (from <= now)
+                return now;
+            if (from < sample.end())
+                change = from;
+        }
+        // Samples of the opposite bound's value all conflict with it, and it overrides those of
+        // lesser confidence
+        const double opposite = sign? lower: upper;
+        if (tighter(sample.value(), opposite)) {
+            for (unsigned c = 0; c < sample.confidence(); c++) {
+                const typename RunsT::const_iterator key = runs[!sign][c].find(opposite);
+                if (key == runs[!sign][c].cend() || key->second.back().end <= now)
+                    continue;
+                const double held = in_effect_until(!sign, sample.confidence(), opposite, now);
+                if (held <= now)
+                    return now;
+                change = std::min(change, held);
+                break;
+            }
+        }
+        return change;
+    }
+
+private:
+    static constexpr double kNever = std::numeric_limits<double>::infinity();
+
+    typedef std::pmr::multimap<double, Sample> MapT;
+    // Samples of one sign that are not subsets of any other, by end. Tightness strictly decreases
+    // from the earliest end to the latest.
+    typedef std::pmr::map<double, typename MapT::iterator> FrontierT;
+    // Starts and ends of samples of one sign, confidence and value, both strictly increasing
+    struct Run {
+        double start, end;
+    };
+    typedef std::pmr::map<double, std::pmr::deque<Run>> RunsT;
+
+    static constexpr bool tighter_or_equal(const Sample &a, const Sample &b) {
+        return a.sign()? a.value() <= b.value(): a.value() >= b.value();
+    }
+
+    // Whether an existing sample can be dropped once a newer superset of it is inserted, without
+    // changing any estimate. This is narrower than being a superset: a subset with a different
+    // value can still take effect whenever the superset is overridden by a sample that it does not
+    // conflict with, and its confidence and age decide which samples it overrides. So only subsets
+    // with the same value and a lower confidence, or an identical start, qualify.
+    static constexpr bool dominates(const Sample &newer, const Sample &older) {
+        return newer.value() == older.value()
+            && (
+                newer.confidence() > older.confidence()
+                || (newer.confidence() == older.confidence() && newer.start() == older.start())
+            );
+    }
+
+    void rebuild_frontiers() {
+        for (auto [map, frontier]: {
+            std::pair(&lower_by_end, &lower_frontier), std::pair(&upper_by_end, &upper_frontier)
+        }) {
+            frontier->clear();
+            for (typename MapT::iterator s = map->upper_bound(expired_until); s != map->end(); ++s) {
+                if (!frontier->empty()) {
+                    typename FrontierT::iterator last = std::prev(frontier->end());
+                    if (last->first == s->first && tighter_or_equal(last->second->second, s->second))
+                        continue;
+                }
+                while (!frontier->empty()
+                    && tighter_or_equal(s->second, std::prev(frontier->end())->second->second))
+                    frontier->erase(std::prev(frontier->end()));
+                frontier->emplace_hint(frontier->end(), s->first, s);
+            }
+        }
+
+        clear_runs();
+        if (incremental) {
+            std::pmr::vector<const Sample *> samples(resource());
+            for (const MapT *map: { &lower_by_end, &upper_by_end }) {
+                for (typename MapT::const_iterator s = map->upper_bound(expired_until); s != map->cend(); ++s)
+                    samples.push_back(&s->second);
+            }
+            std::sort(samples.begin(), samples.end(), [](const Sample *a, const Sample *b) {
+                return a->start() < b->start() || (a->start() == b->start() && a->end() < b->end());
+            });
+            for (const Sample *sample: samples)
+                add_run(*sample);
+        }
+    }
+
+    void clear_runs() {
+        for (RunsT (&by_confidence)[4]: runs) {
+            for (RunsT &by_value: by_confidence)
+                by_value.clear();
+        }
+        next_run_expiry = kNever;
+    }
+
+    // Samples arrive in order of start. Within a value of a sign and confidence, only the oldest
+    // valid start takes part in overrides, and one that starts later and ends no later than
+    // another never determines anything, as in BitsetPhotometer.
+    void add_run(const Sample &sample) {
+        std::pmr::deque<Run> &key = runs[sample.sign()][sample.confidence()][sample.value()];
+        if (!key.empty() && key.back().end >= sample.end())
+            return;
+        key.push_back(Run { .start = sample.start(), .end = sample.end() });
+        next_run_expiry = std::min(next_run_expiry, key.front().end);
+    }
+
+    void erase_old_runs() {
+        if (expired_until < next_run_expiry)
+            return;
+        next_run_expiry = kNever;
+        for (RunsT (&by_confidence)[4]: runs) {
+            for (RunsT &by_value: by_confidence) {
+                for (typename RunsT::iterator key = by_value.begin(); key != by_value.end();) {
+                    while (!key->second.empty() && key->second.front().end <= expired_until)
+                        key->second.pop_front();
+                    if (key->second.empty())
+                        key = by_value.erase(key);
+                    else {
+                        next_run_expiry = std::min(next_run_expiry, key->second.front().end);
+                        ++key;
+                    }
+                }
+            }
+        }
+    }
+
+    // Calls visit(value, runs) on the values of one sign and confidence no tighter than a limit,
+    // from the tightest, until it returns false
+    template <typename Visit>
+    void visit_runs(bool sign, unsigned confidence, double limit, Visit visit) const {
+        const RunsT &by_value = runs[sign][confidence];
+        if (sign) {
+            for (typename RunsT::const_iterator key = by_value.lower_bound(limit); key != by_value.cend(); ++key) {
+                if (!visit(key->first, key->second))
+                    return;
+            }
+        }
+        else {
+            for (
+                typename RunsT::const_reverse_iterator key(by_value.upper_bound(limit));
+                key != by_value.crend(); ++key
+            ) {
+                if (!visit(key->first, key->second))
+                    return;
+            }
+        }
+    }
+
+    // The latest end of the samples overriding one of a sign, confidence, value and start, from
+    // the runs, or -infinity if none do. Those of its confidence only override it if they started
+    // earlier.
+    double overridden_until(bool sign, unsigned confidence, double value, double start) const {
+        double until = -kNever;
+        for (unsigned c = confidence; c < 4; c++) {
+            const RunsT &by_value = runs[!sign][c];
+            // Uppers conflict with lesser lowers, and lowers with greater uppers
+            const typename RunsT::const_iterator
+                first = sign? by_value.upper_bound(value): by_value.cbegin(),
+                last = sign? by_value.cend(): by_value.lower_bound(value);
+            for (typename RunsT::const_iterator key = first; key != last; ++key) {
+                typename std::pmr::deque<Run>::const_iterator earlier = key->second.cend();
+                if (c == confidence)
+                    earlier = std::partition_point(
+                        key->second.cbegin(), key->second.cend(),
+                        [start](const Run &run) { return run.start < start; }
+                    );
+                if (earlier != key->second.cbegin())
+                    until = std::max(until, std::prev(earlier)->end);
+            }
+        }
+        return until;
+    }
+
+    // The latest end of the samples of a sign and value, of at least a confidence, that are in
+    // effect now, from the runs, or -infinity if none are. A later start is overridden by no
+    // fewer samples, so those of each run in effect are a prefix of it.
+    double in_effect_until(bool sign, unsigned confidence, double value, double now) const {
+        double until = -kNever;
+        for (unsigned c = confidence; c < 4; c++) {
+            const typename RunsT::const_iterator key = runs[sign][c].find(value);
+            if (key == runs[sign][c].cend())
+                continue;
+            const typename std::pmr::deque<Run>::const_iterator in_effect = std::partition_point(
+                key->second.cbegin(), key->second.cend(),
+                [&](const Run &run) { return overridden_until(sign, c, value, run.start) <= now; }
+            );
+            if (in_effect != key->second.cbegin())
+                until = std::max(until, std::prev(in_effect)->end);
+        }
+        return until;
+    }
+
+    // One bound as of t from the runs, as resolve() gives it. The values of each confidence that
+    // no opposite bound of greater confidence conflicts with are walked from the tightest, until
+    // one is no younger than every conflicting opposite value of its confidence, which are found
+    // from the oldest start of the opposite values in order. No sample is visited on its own.
+    void resolve_runs(
+        bool sign, double t, double &value, uint8_t &confidence, double &end, Workspace &workspace
+    ) const {
+        std::pmr::vector<typename Workspace::Rival> &rivals = workspace.rivals;
+        const auto tighter = [sign](double a, double b) { return sign? a < b: a > b; };
+        const auto oldest = [t](const std::pmr::deque<Run> &key) {
+            const typename std::pmr::deque<Run>::const_iterator live = std::partition_point(
+                key.cbegin(), key.cend(), [t](const Run &run) { return run.end <= t; }
+            );
+            return live == key.cend()? kNever: live->start;
+        };
+
+        value = (sign? universal_upper: universal_lower).value();
+        confidence = 0;
+        end = kNever;
+        bool found = false;
+        // Tightest opposite value valid as of t of any confidence above the current one
+        double above = (sign? universal_lower: universal_upper).value();
+        for (int c = 3; c >= 0; c--) {
+            // Opposite values of this confidence, tightest first, each with the oldest start of it
+            // and every tighter one; those that a bound conflicts with are a prefix
+            rivals.clear();
+            visit_runs(!sign, c, sign? kNever: -kNever, [&](double v, const std::pmr::deque<Run> &key) {
+                const double start = oldest(key);
+                if (start != kNever) {
+                    rivals.push_back(typename Workspace::Rival {
+                        .value = v,
+                        .oldest = std::min(start, rivals.empty()? kNever: rivals.back().oldest),
+                    });
+                }
+                return true;
+            });
+
+            size_t n = rivals.size();
+            visit_runs(sign, c, above, [&](double v, const std::pmr::deque<Run> &key) {
+                if (found && tighter(value, v))
+                    return false;
+                const double start = oldest(key);
+                if (start == kNever)
+                    return true;
+                while (n > 0 && !tighter(v, rivals[n - 1].value))
+                    n--;
+                const double rival = n > 0? rivals[n - 1].oldest: kNever;
+                if (rival < start)
+                    return true;
+
+                // In effect; of its samples, the latest ending one that no rival is older than
+                const double latest = std::prev(std::partition_point(
+                    key.cbegin(), key.cend(), [rival](const Run &run) { return run.start <= rival; }
+                ))->end;
+                if (!found || tighter(v, value) || latest > end) {
+                    value = v;
+                    confidence = c;
+                    end = latest;
+                    found = true;
+                }
+                return false;
+            });
+
+            if (!rivals.empty() && tighter(above, rivals.front().value))
+                above = rivals.front().value;
+        }
+    }
+
+    // Read-only view of the samples still valid at some time. Since the maps are keyed by end,
+    // the expired entries are a prefix of each map and are skipped rather than copied out. This
+    // includes those that erase_old() has yet to reclaim.
+    struct AsOf {
+        typename MapT::const_iterator lower_begin, upper_begin;
+    };
+
+    AsOf all() const {
+        return as_of(-kNever);
+    }
+
+    AsOf as_of(double now) const {
+        // Same half-open interval as erase_old(): samples ending at or before now are expired
+        now = std::max(now, expired_until);
+        return AsOf { lower_by_end.upper_bound(now), upper_by_end.upper_bound(now) };
+    }
+
+    // Fills in the bounds and their samples, from one scan of the view per sign
+    void resolve(const AsOf &view, Bounds &bounds, Workspace &workspace) const {
+        for (auto [effective, value, confidence, end]: {
+            std::tuple(
+                &lower(view, workspace), &bounds.lower, &bounds.lower_confidence, &bounds.lower_end
+            ),
+            std::tuple(
+                &upper(view, workspace), &bounds.upper, &bounds.upper_confidence, &bounds.upper_end
+            ),
+        }) {
+            const bool universal = effective == &universal_lower || effective == &universal_upper;
+            *value = effective->value();
+            *confidence = universal? 0: effective->confidence();
+            *end = universal? kNever: effective->end();
+        }
+    }
+
+    static Resolution resolution(const Bounds &bounds) {
+        return Resolution {
+            .lower = bounds.lower,
+            .upper = bounds.upper,
+            .midpoint = 0.5*(bounds.lower + bounds.upper),
+            .lower_confidence = bounds.lower_confidence,
+            .upper_confidence = bounds.upper_confidence,
+            .lower_end = bounds.lower_end,
+            .upper_end = bounds.upper_end,
+        };
+    }
+
+    const Sample &lower(const AsOf &view, Workspace &workspace) const {
+        OverrideIndex &index = workspace.index;
+        index.clear(true);
+        for (typename MapT::const_iterator u = view.upper_begin; u != upper_by_end.cend(); ++u)
+            index.add(u->second);
+        index.finish();
+
+        const Sample *effective_lower = &universal_lower;
+        for (typename MapT::const_iterator l = view.lower_begin; l != lower_by_end.cend(); ++l) {
+            if (!index.overrides(l->second))
+                effective_lower = &effective_lower->resolve_lower(l->second);
+            else tally(&PhotometerStats::overridden);
+        }
+        return *effective_lower;
+    }
+
+    const Sample &upper(const AsOf &view, Workspace &workspace) const {
+        OverrideIndex &index = workspace.index;
+        index.clear(false);
+        for (typename MapT::const_iterator l = view.lower_begin; l != lower_by_end.cend(); ++l)
+            index.add(l->second);
+        index.finish();
+
+        const Sample *effective_upper = &universal_upper;
+        for (typename MapT::const_iterator u = view.upper_begin; u != upper_by_end.cend(); ++u) {
+            if (!index.overrides(u->second))
+                effective_upper = &effective_upper->resolve_upper(u->second);
+            else tally(&PhotometerStats::overridden);
+        }
+        return *effective_upper;
+    }
+
+    // Into the lowers and uppers of the workspace, which is returned
+    Workspace &effective_spans(Workspace &workspace) const {
+        const AsOf view = all();
+        std::pmr::vector<const Sample *> &samples = workspace.samples;
+        std::pmr::vector<double> &values = workspace.values;
+        std::pmr::vector<Span> &lowers = workspace.lowers, &uppers = workspace.uppers;
+        samples.clear();
+        values.clear();
+        lowers.clear();
+        uppers.clear();
+        samples.reserve(size());
+        for (typename MapT::const_iterator l = view.lower_begin; l != lower_by_end.cend(); ++l)
+            samples.push_back(&l->second);
+        for (typename MapT::const_iterator u = view.upper_begin; u != upper_by_end.cend(); ++u)
+            samples.push_back(&u->second);
+
+        // Conflicts only depend on value order, so bounds are indexed by the rank of their value
+        values.reserve(samples.size());
+        for (const Sample *sample: samples)
+            values.push_back(sample->value());
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        const auto rank = [&values](const Sample &sample) -> size_t {
+            return std::lower_bound(values.begin(), values.end(), sample.value()) - values.begin();
+        };
+
+        // A sample overrides another if it comes first by greater confidence then earlier start,
+        // and they conflict. So visiting samples in that order, the overriders of each are among
+        // those already visited, except for those tied with it, which are visited as a group.
+        std::sort(
+            samples.begin(), samples.end(),
+            [](const Sample *a, const Sample *b) {
+                return a->confidence() > b->confidence()
+                    || (a->confidence() == b->confidence() && a->start() < b->start());
+            }
+        );
+        // Latest ends of uppers by value rank, and of lowers by reversed value rank
+        PrefixMax &upper_ends = workspace.upper_ends, &lower_ends = workspace.lower_ends;
+        upper_ends.reset(values.size());
+        lower_ends.reset(values.size());
+        for (size_t first = 0, last; first < samples.size(); first = last) {
+            for (last = first; last < samples.size()
+                && samples[last]->confidence() == samples[first]->confidence()
+                && samples[last]->start() == samples[first]->start(); last++) {
+                const Sample &sample = *samples[last];
+                // Uppers conflict with lesser lowers, and lowers with greater uppers
+                const double killed = sample.sign()
+                    ? lower_ends.below(values.size() - 1 - rank(sample))
+                    : upper_ends.below(rank(sample));
+                if (killed < sample.end())
+                    (sample.sign()? uppers: lowers).push_back(Span {
+                        .from = killed, .until = sample.end(), .value = sample.value(),
+                    });
+            }
+            for (size_t i = first; i < last; i++) {
+                const Sample &sample = *samples[i];
+                if (sample.sign())
+                    upper_ends.record(rank(sample), sample.end());
+                else lower_ends.record(values.size() - 1 - rank(sample), sample.end());
+            }
+        }
+        return workspace;
+    }
+
+    // Of one bound, from the spans of its sign
+    static double next_bounds_change(bool sign, const std::pmr::vector<Span> &spans, double now) {
+        const auto tighter = [sign](double a, double b) { return sign? a < b: a > b; };
+        // The bound as of now, and when the last of the spans giving it ends
+        double bound = (sign? universal_upper: universal_lower).value(), until = kNever;
+        for (const Span &span: spans) {
+            if (span.from > now || span.until <= now)
+                continue;
+            if (tighter(span.value, bound)) {
+                bound = span.value;
+                until = span.until;
+            }
+            else if (span.value == bound)
+                until = std::max(until, span.until);
+        }
+        for (const Span &span: spans) {
+            if (span.from > now && tighter(span.value, bound))
+                until = std::min(until, span.from);
+        }
+        return until;
+    }
+
+    double in_ticks(Ticks now) const {
+        assert(clock != ClockKind::seconds);
+        return static_cast<double>(now);
+    }
+
+    void checkpoint(ClockKind kind, double now, std::vector<uint8_t> &out) const {
+        const AsOf view = as_of(now);
+        const size_t header = out.size();
+        out.resize(header + checkpoint::kHeaderBytes);
+        for (auto [s, end]: {
+            std::pair(view.lower_begin, lower_by_end.cend()), std::pair(view.upper_begin, upper_by_end.cend())
+        }) {
+            for (; s != end; ++s) {
+                const std::array<uint8_t, 2> frame = s->second.raw(kind).to_bytes();
+                const double offset = std::round((s->second.start() - now)/checkpoint::unit(kind));
+                assert(std::fabs(offset) < 0x1p31);
+                out.insert(out.end(), frame.begin(), frame.end());
+                out.resize(out.size() + 4);
+                checkpoint::put_u32(&out.back() - 3, static_cast<int32_t>(offset));
+            }
+        }
+
+        uint8_t *p = out.data() + header;
+        const size_t samples = (out.size() - header - checkpoint::kHeaderBytes)/checkpoint::kSampleBytes;
+        std::copy(std::begin(checkpoint::kMagic), std::end(checkpoint::kMagic), p);
+        checkpoint::put_u32(p + 8, samples);
+        p[16] = static_cast<uint8_t>(kind);
+        checkpoint::put_u32(p + 12, checkpoint::hash(
+            p + checkpoint::kHashedFrom, out.size() - header - checkpoint::kHashedFrom
+        ));
+    }
+
+    bool restore(ClockKind kind, double now, const uint8_t *data, size_t bytes) {
+        if (bytes < checkpoint::kHeaderBytes
+            || !std::equal(std::begin(checkpoint::kMagic), std::end(checkpoint::kMagic), data))
+            return false;
+        const size_t samples = checkpoint::get_u32(data + 8);
+        const uint8_t *p = data + checkpoint::kHeaderBytes;
+        if ((bytes - checkpoint::kHeaderBytes)/checkpoint::kSampleBytes != samples
+            || (bytes - checkpoint::kHeaderBytes) % checkpoint::kSampleBytes != 0
+            || checkpoint::hash(data + checkpoint::kHashedFrom, bytes - checkpoint::kHashedFrom)
+                != checkpoint::get_u32(data + 12)
+            || data[16] != static_cast<uint8_t>(kind) || data[17] || data[18] || data[19])
+            return false;
+
+        lower_by_end.clear();
+        upper_by_end.clear();
+        for (size_t i = 0; i < samples; i++, p += checkpoint::kSampleBytes) {
+            const RawSample raw = RawSample::from_bytes({ p[0], p[1] });
+            const double start =
+                now + static_cast<int32_t>(checkpoint::get_u32(p + 2))*checkpoint::unit(kind);
+            // In ticks, recomputed as from_raw() would, but allowing starts before tick 0
+            const Sample sample = kind == ClockKind::ticks
+                ? Sample(
+                    start, start + static_cast<double>(raw.horizon_ticks<Policy>()),
+                    raw.sign, raw.value_lx<Policy>(), raw.clear, raw.confidence
+                )
+                : Sample(start, raw);
+            MapT &target = sample.sign()? upper_by_end: lower_by_end;
+            target.emplace_hint(target.end(), sample.end(), sample);
+        }
+        expired_until = -kNever;
+        latest = -kNever;
+        clock = kind;
+        version.renew();
+        rebuild_frontiers();
+        return true;
+    }
+
+    void changed(double now) {
+        version.renew();
+        latest = std::max(latest, now);
+    }
+
+    // Versions of the samples of every meter of this type, never reused, so that a workspace can
+    // tell whether its cache is of the meter it is given as it is now
+    static uint64_t next_version() {
+        static std::atomic<uint64_t> last {0};
+        return last.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void clear() {
+        lower_by_end.clear();
+        upper_by_end.clear();
+        lower_frontier.clear();
+        upper_frontier.clear();
+        clear_runs();
+    }
+
+    void insert(const Sample &sample) {
+        MapT &target = sample.sign()? upper_by_end: lower_by_end;
+        FrontierT &frontier = sample.sign()? upper_frontier: lower_frontier;
+
+        // If any sample is a superset of this one, so is the tightest one ending no earlier
+        typename FrontierT::iterator later = frontier.lower_bound(sample.end());
+        if (later != frontier.end() && later->second->second.is_superset_of(sample)) {
+            tally(&PhotometerStats::rejected);
+            return;
+        }
+
+        // Remove the frontier samples that this one is a superset of: they end no later, and are
+        // contiguous since tightness increases towards earlier ends
+        typename FrontierT::iterator displaced = later;
+        if (displaced != frontier.end() && displaced->first == sample.end())
+            ++displaced;
+        while (
+            displaced != frontier.begin()
+            && tighter_or_equal(sample, std::prev(displaced)->second->second)
+        ) --displaced;
+        for (typename FrontierT::iterator f = displaced; f != frontier.end() && f->first <= sample.end();) {
+            if (dominates(sample, f->second->second))
+                target.erase(f->second);
+            f = frontier.erase(f);
+        }
+
+        frontier.emplace(sample.end(), target.emplace(sample.end(), sample));
+        if (incremental)
+            add_run(sample);
+        if constexpr (kKeepsStats)
+            stats_.peak_size = std::max(stats_.peak_size, size());
+    }
+
+    void tally(uint64_t PhotometerStats::*counter) const {
+        if constexpr (kKeepsStats)
+            stats_.*counter += 1;
+    }
+
+    // On behalf of a number of frames, each allowed the expiry budget
+    void erase_old(double now, size_t frames = 1) {
+        // Expire samples with ends up to and including now
+        // This uses a half-open interval
+        expired_until = std::max(expired_until, now);
+
+        // Frontiers hold at most one entry per value, so they are always pruned in full, and then
+        // refer to no expired sample
+        lower_frontier.erase(lower_frontier.begin(), lower_frontier.upper_bound(expired_until));
+        upper_frontier.erase(upper_frontier.begin(), upper_frontier.upper_bound(expired_until));
+        erase_old_runs();
+
+        // Reclaim expired samples up to the budget, earliest end first
+        const size_t total = expiry_budget > std::numeric_limits<size_t>::max()/frames
+            ? std::numeric_limits<size_t>::max(): expiry_budget*frames;
+        for (size_t budget = total; budget > 0; budget--) {
+            const bool lower_expired =
+                !lower_by_end.empty() && lower_by_end.begin()->first <= expired_until;
+            const bool upper_expired =
+                !upper_by_end.empty() && upper_by_end.begin()->first <= expired_until;
+            if (!lower_expired && !upper_expired)
+                break;
+            MapT &map = !upper_expired
+                || (lower_expired && lower_by_end.begin()->first <= upper_by_end.begin()->first)
+                ? lower_by_end: upper_by_end;
+            map.erase(map.begin());
+            tally(&PhotometerStats::expired);
+        }
+    }
+
+    MapT lower_by_end, upper_by_end;
+    FrontierT lower_frontier, upper_frontier;
+    // In incremental mode, samples by sign, confidence and value. These can still hold samples
+    // that insert() dropped as dominated, which changes nothing: whatever a dominated sample
+    // overrides, the one dominating it overrides too, and it is in effect only when that one is.
+    RunsT runs[2][4];
+    double next_run_expiry = kNever;
+    // Samples ending at or before this have expired, but may not have been reclaimed
+    double expired_until = -kNever;
+    size_t expiry_budget = std::numeric_limits<size_t>::max();
+    bool incremental = false;
+    ClockKind clock = ClockKind::unset;
+
+    // Of the samples, as workspaces check their cache against. Every change renews it, and so
+    // does a move for the meter moved from, which is left empty while its samples keep theirs.
+    class Version {
+    public:
+        Version() = default;
+        Version(Version &&other) noexcept: value(std::exchange(other.value, next_version())) { }
+
+        uint64_t id() const { return value; }
+        void renew() { value = next_version(); }
+
+    private:
+        uint64_t value = next_version();
+    };
+
+    double latest = -kNever;
+    Version version;
+
+    using Lease = typename Lendable<Workspace>::Lease;
+    Lendable<Workspace> own_workspace;
+
+    // Recorded by const calls too, so only an InstrumentedPhotometer needs its calls serialised
+    [[no_unique_address]] mutable Stats stats_;
+};
+
+using Photometer = BasicPhotometer<DimbulbPolicy>;
+using InstrumentedPhotometer = BasicPhotometer<DimbulbPolicy, PhotometerStats>;
+
+// FIFO over contiguous storage that doubles its capacity when full, so that pushes and pops are
+// O(1) and never allocate once the buffer has grown to its working size
+template <typename T>
+class Ring {
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T &operator[](size_t i) const { return slots[(head + i) & (slots.size() - 1)]; }
+    const T &front() const { return (*this)[0]; }
+    const T &back() const { return (*this)[count - 1]; }
+
+    void push_back(const T &value) {
+        if (count == slots.size())
+            grow(value);
+        slots[(head + count) & (slots.size() - 1)] = value;
+        count++;
+    }
+
+    void pop_front() {
+        head = (head + 1) & (slots.size() - 1);
+        count--;
+    }
+
+    void pop_back() { count--; }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    // Index of the first element for which pred is false, given that the ring is partitioned
+    template <typename Pred>
+    size_t partition_point(Pred pred) const {
+        size_t first = 0, n = count;
+        while (n > 0) {
+            size_t half = n/2;
+            if (pred((*this)[first + half])) {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else n = half;
+        }
+        return first;
+    }
+
+private:
+    // Indices wrap with a mask, so the number of slots is always a power of two, whatever
+    // capacity the vector has
+    void grow(const T &fill) {
+        const size_t slot_count = std::max<size_t>(16, 2*slots.size());
+        assert(std::has_single_bit(slot_count));
+        std::vector<T> bigger;
+        bigger.reserve(slot_count);
+        for (size_t i = 0; i < count; i++)
+            bigger.push_back((*this)[i]);
+        bigger.resize(slot_count, fill);
+        slots.swap(bigger);
+        head = 0;
+    }
+
+    std::vector<T> slots;
+    size_t head = 0, count = 0;
+};
+
+
+// Bounds of one sign pushed in end order, reduced to those that are tighter than every later one.
+// These stay in end order with decreasing tightness, so the first of them ending no earlier than
+// some time is the tightest of all the bounds pushed that end no earlier than that time.
+class TightestQueue {
+public:
+    // Orders values so that greater keys are tighter bounds
+    static constexpr double key(const Sample &sample) {
+        return sample.sign()? -sample.value(): sample.value();
+    }
+
+    void push(double end, double key) {
+        while (!entries.empty() && entries.back().key <= key)
+            entries.pop_back();
+        entries.push_back(Entry { .end = end, .key = key });
+    }
+
+    void erase_old(double now) {
+        while (!entries.empty() && entries.front().end <= now)
+            entries.pop_front();
+    }
+
+    void clear() { entries.clear(); }
+
+    // Whether any bound ending no earlier than end is at least as tight as key; with the key of a
+    // sample of the same sign, equivalent to testing is_superset_of() on every bound pushed
+    bool covers(double end, double key) const {
+        const size_t i = entries.partition_point(
+            [end](const Entry &entry) { return entry.end < end; }
+        );
+        return i < entries.size() && entries[i].key >= key;
+    }
+
+private:
+    struct Entry {
+        double end, key;
+    };
+
+    Ring<Entry> entries;
+};
+
+
+// Photometer storing samples in one FIFO per sign and horizon, rather than in maps keyed by end.
+// Timestamps are monotonic, so samples sharing a horizon expire in arrival order: inserts and
+// expiry are O(1), and estimates are the same as those of Photometer.
+class WheelPhotometer {
+public:
+    static constexpr unsigned kHorizons = 16;
+
+    size_t size() const {
+        size_t n = 0;
+        for (const Bucket (&by_horizon)[kHorizons]: buckets)
+            for (const Bucket &bucket: by_horizon)
+                n += bucket.samples.size();
+        return n;
+    }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        const RawSample raw = RawSample::from_bytes(data);
+        consume(Sample(now, raw), raw.horizon);
+    }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        Lendable<OverrideIndex>::Lease lease(scratch);
+        OverrideIndex &index = *lease;
+        index.clear(true);
+        for_each_as_of(true, now, [&index](const Sample &u) { index.add(u); });
+        index.finish();
+
+        const Sample *effective_lower = &universal_lower;
+        for_each_as_of(false, now, [&index, &effective_lower](const Sample &l) {
+            if (!index.overrides(l))
+                effective_lower = &effective_lower->resolve_lower(l);
+        });
+        return effective_lower->value();
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        Lendable<OverrideIndex>::Lease lease(scratch);
+        OverrideIndex &index = *lease;
+        index.clear(false);
+        for_each_as_of(false, now, [&index](const Sample &l) { index.add(l); });
+        index.finish();
+
+        const Sample *effective_upper = &universal_upper;
+        for_each_as_of(true, now, [&index, &effective_upper](const Sample &u) {
+            if (!index.overrides(u))
+                effective_upper = &effective_upper->resolve_upper(u);
+        });
+        return effective_upper->value();
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return 0.5*(lower(now) + upper(now));
+    }
+
+private:
+    // Samples of one sign and horizon in arrival order, which is also end order
+    struct Bucket {
+        void push(const Sample &sample) {
+            samples.push_back(sample);
+            tightest.push(sample.end(), TightestQueue::key(sample));
+        }
+
+        void erase_old(double now) {
+            while (!samples.empty() && samples.front().end() <= now)
+                samples.pop_front();
+            tightest.erase_old(now);
+        }
+
+        void clear() {
+            samples.clear();
+            tightest.clear();
+        }
+
+        Ring<Sample> samples;
+        TightestQueue tightest;
+    };
+
+    void consume(const Sample &sample, unsigned horizon) {
+        if (sample.should_clear()) {
+            for (Bucket (&by_horizon)[kHorizons]: buckets)
+                for (Bucket &bucket: by_horizon)
+                    bucket.clear();
+        }
+        else {
+            for (Bucket (&by_horizon)[kHorizons]: buckets)
+                for (Bucket &bucket: by_horizon)
+                    bucket.erase_old(sample.start());
+        }
+
+        Bucket (&target)[kHorizons] = buckets[sample.sign()];
+        if (std::none_of(
+            std::cbegin(target), std::cend(target),
+            [&sample](const Bucket &bucket) {
+                return bucket.tightest.covers(sample.end(), TightestQueue::key(sample));
+            }
+        ))
+            target[horizon].push(sample);
+    }
+
+    template <typename F>
+    void for_each_as_of(bool sign, double now, F f) const {
+        for (const Bucket &bucket: buckets[sign]) {
+            const Ring<Sample> &samples = bucket.samples;
+            for (
+                size_t i = samples.partition_point(
+                    [now](const Sample &sample) { return sample.end() <= now; }
+                );
+                i < samples.size();
+                i++
+            )
+                f(samples[i]);
+        }
+    }
+
+    Bucket buckets[2][kHorizons];  // by sign, then by horizon
+
+    // Scratch space for lower() and upper()
+    Lendable<OverrideIndex> scratch;
+};
+
+// Photometer with one slot per (sign, confidence, value code), so that it holds at most 2048 live
+// samples in about 52 KB of fixed arrays, no matter the frame rate or horizons. Each slot covers
+// a run of samples with the same key that overlap in time, and holds the start of the oldest and
+// the end of the latest.
+//
+// Samples with the same key only differ in their start and end times. The latest end decides when
+// the key stops being valid and which new samples it is a superset of, so those are reproduced
+// exactly. Start times only break ties between conflicting samples of equal confidence, where the
+// older sample wins, and a slot that merged a later sample into its run keeps the start of the
+// first even after that one would have expired. From then until the slot expires it can win ties
+// that Photometer gives to the newer conflicting sample, and estimates may differ; exact() tells
+// when they cannot. Otherwise they are the same as those of Photometer.
+class CompactPhotometer {
+public:
+    static constexpr unsigned kConfidences = 4, kValues = 256;
+
+    CompactPhotometer() { clear(); }
+
+    // Number of live slots as of the last consume
+    size_t size() const {
+        size_t n = 0;
+        for (const Slot (&by_confidence)[kConfidences][kValues]: slots)
+            for (const Slot (&by_value)[kValues]: by_confidence)
+                for (const Slot &slot: by_value)
+                    n += slot.end > latest;
+        return n;
+    }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        const RawSample raw = RawSample::from_bytes(data);
+        const Sample sample(now, raw);
+        latest = now;
+
+        if (sample.should_clear())
+            clear();
+
+        // Expired slots end no later than now, so they can never be supersets of the new sample
+        const unsigned code = index(raw.value);
+        const double (&ends)[kValues] = end_by_value[raw.sign];
+        if (raw.sign) {
+            if (std::any_of(
+                std::cbegin(ends), std::cbegin(ends) + code + 1,
+                [&sample](double end) { return end >= sample.end(); }
+            )) return;
+        }
+        else if (std::any_of(
+            std::cbegin(ends) + code, std::cend(ends),
+            [&sample](double end) { return end >= sample.end(); }
+        )) return;
+
+        // Not being a superset of it, a live slot of the key ends before the new sample
+        Slot &slot = slots[raw.sign][raw.confidence][code];
+        if (slot.end <= now)
+            slot = Slot { .start = now, .end = sample.end() };
+        else {
+            slot.exact_until = std::min(slot.exact_until, slot.end);
+            slot.end = sample.end();
+        }
+        end_by_value[raw.sign][code] = sample.end();
+    }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        return effective(false, now);
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        return effective(true, now);
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return 0.5*(lower(now) + upper(now));
+    }
+
+    // Whether estimates as of now are certain to be the same as Photometer's: no slot valid then
+    // has outlived the sample whose start it keeps
+    bool exact(
+        double now  // monotonic seconds
+    ) const {
+        for (const Slot (&by_confidence)[kConfidences][kValues]: slots)
+            for (const Slot (&by_value)[kValues]: by_confidence)
+                for (const Slot &slot: by_value) {
+                    if (slot.end > now && slot.exact_until <= now)
+                        return false;
+                }
+        return true;
+    }
+
+private:
+    // End of a slot that never held a sample, before any time
+    static constexpr double kNoEnd = std::numeric_limits<double>::lowest();
+
+    struct Slot {
+        double start = kNoEnd, end = kNoEnd;
+        // End of the first sample of the run, once a later one is merged in, after which the
+        // start is older than that of any valid sample of the key
+        double exact_until = std::numeric_limits<double>::infinity();
+    };
+
+    void clear() {
+        for (Slot (&by_confidence)[kConfidences][kValues]: slots)
+            for (Slot (&by_value)[kValues]: by_confidence)
+                std::fill(std::begin(by_value), std::end(by_value), Slot());
+        for (double (&by_value)[kValues]: end_by_value)
+            std::fill(std::begin(by_value), std::end(by_value), kNoEnd);
+    }
+
+    static constexpr unsigned index(int16_t value) { return value + kValues/2; }
+
+    static constexpr double value_lx(unsigned index) {
+        return RawSample { .value = static_cast<int16_t>(int(index) - int(kValues/2)) }.value_lx();
+    }
+
+    // Effective bound of one sign. Ranks order the value codes so that a bound conflicts with
+    // every opposite bound of lesser rank, and the tightest bound has the greatest rank.
+    double effective(bool sign, double now) const {
+        constexpr auto rank = [](bool sign, unsigned index) {
+            return sign? kValues - 1 - index: index;
+        };
+        const Slot (&opposite)[kConfidences][kValues] = slots[!sign];
+
+        // Least rank of any live opposite bound, over confidences greater than each one, and the
+        // oldest start of any live opposite bound of the same confidence, with rank below each one
+        unsigned least_rank_above[kConfidences];
+        double oldest_below[kConfidences][kValues];
+        unsigned least = kValues;
+        for (unsigned c = kConfidences; c-- > 0;) {
+            least_rank_above[c] = least;
+            double oldest = std::numeric_limits<double>::infinity();
+            for (unsigned r = 0; r < kValues; r++) {
+                oldest_below[c][r] = oldest;
+                const Slot &slot = opposite[c][rank(sign, r)];
+                if (slot.end > now) {
+                    oldest = std::min(oldest, slot.start);
+                    least = std::min(least, r);
+                }
+            }
+        }
+
+        for (unsigned r = kValues; r-- > 0;) {
+            const unsigned i = rank(sign, r);
+            for (unsigned c = 0; c < kConfidences; c++) {
+                const Slot &slot = slots[sign][c][i];
+                if (
+                    slot.end > now
+                    && least_rank_above[c] >= r
+                    && oldest_below[c][r] >= slot.start
+                ) return value_lx(i);
+            }
+        }
+        return sign? universal_upper.value(): universal_lower.value();
+    }
+
+    Slot slots[2][kConfidences][kValues];  // by sign, confidence and value index
+    // Latest end of each sign and value index over all confidences, for the superset test
+    double end_by_value[2][kValues];
+    double latest = kNoEnd;
+};
+
+// Photometer storing samples as structure-of-arrays: per sign and horizon, dense arrays of start
+// times, value codes and confidences, about 10 bytes per sample. Ends are recomputed from the
+// start and horizon exactly as Sample computes them, and samples sharing a horizon expire in
+// arrival order, so live samples are a contiguous suffix of each bucket.
+//
+// Rather than sorting through an OverrideIndex, lower() and upper() tabulate the oldest start of
+// the opposite bounds for each confidence and value code. Overrides only depend on which codes
+// conflict, confidence and which start is older, so this is exact, and estimates are the same as
+// those of Photometer. Each estimate is two dense scans over the live samples plus a fixed cost.
+//
+// Like Photometer, it takes either clock, with ends exact in ticks on an integer one, but must be
+// kept to the one it was first given; debug builds assert so.
+class PackedPhotometer {
+public:
+    static constexpr unsigned kHorizons = 16, kConfidences = 4, kValues = 256;
+
+    size_t size() const {
+        size_t n = 0;
+        for (const Bucket (&by_horizon)[kHorizons]: buckets)
+            for (const Bucket &bucket: by_horizon)
+                n += bucket.size();
+        return n;
+    }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        latch_clock(clock, ClockKind::seconds);
+        consume(RawSample::from_bytes(data), Sample::from_raw(now, data));
+    }
+
+    // Same, with an integer clock, to which the meter must then keep, as for Photometer
+    void consume(
+        Ticks now,
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        latch_clock(clock, ClockKind::ticks);
+        consume(RawSample::from_bytes(data), Sample::from_raw(now, data));
+    }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        return effective(false, now);
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        return effective(true, now);
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return 0.5*(lower(now) + upper(now));
+    }
+
+    double lower(Ticks now) const { return lower(in_ticks(now)); }
+    double upper(Ticks now) const { return upper(in_ticks(now)); }
+    double estimate(Ticks now) const { return estimate(in_ticks(now)); }
+
+    // Earliest end of any sample valid as of now, after which the estimate may change; infinity
+    // if there is no such sample
+    double next_change_time(
+        double now  // monotonic seconds
+    ) const {
+        double next = std::numeric_limits<double>::infinity();
+        for (const Bucket (&by_horizon)[kHorizons]: buckets) {
+            for (unsigned h = 0; h < kHorizons; h++) {
+                const Bucket &bucket = by_horizon[h];
+                const size_t i = bucket.first_as_of(length(h), now);
+                if (i < bucket.starts.size())
+                    next = std::min(next, bucket.starts[i] + length(h));
+            }
+        }
+        return next;
+    }
+
+private:
+    // Value offset by half the range, so that codes and values are in the same order
+    static constexpr uint8_t code(int16_t value) { return value + kValues/2; }
+
+    static constexpr double value_lx(unsigned code) { return kValueLx[code ^ kValues/2]; }
+
+    // Horizons in ticks, exact as doubles, so that start + length is the end Sample gives
+    static constexpr std::array<double, kHorizons> kHorizonTickLengths = [] {
+        std::array<double, kHorizons> table;
+        for (unsigned h = 0; h < kHorizons; h++)
+            table[h] = static_cast<double>(kHorizonTicks[h]);
+        return table;
+    }();
+
+    // Of a horizon, on the meter's clock; ends are recomputed as start + length
+    double length(unsigned horizon) const {
+        return clock == ClockKind::ticks? kHorizonTickLengths[horizon]: kHorizonS[horizon];
+    }
+
+    double in_ticks(Ticks now) const {
+        assert(clock != ClockKind::seconds);
+        return static_cast<double>(now);
+    }
+
+    void consume(const RawSample &raw, const Sample &sample) {
+        const double now = sample.start();
+        for (unsigned h = 0; h < kHorizons; h++) {
+            for (Bucket (&by_horizon)[kHorizons]: buckets) {
+                if (sample.should_clear())
+                    by_horizon[h].clear();
+                else by_horizon[h].erase_old(length(h), now);
+            }
+        }
+
+        Bucket (&target)[kHorizons] = buckets[raw.sign];
+        const double key = TightestQueue::key(sample);
+        if (std::none_of(
+            std::cbegin(target), std::cend(target),
+            [&sample, key](const Bucket &bucket) { return bucket.tightest.covers(sample.end(), key); }
+        ))
+            target[raw.horizon].push(now, code(raw.value), raw.confidence, sample.end(), key);
+    }
+
+    // Samples of one sign and horizon in arrival order, which is also end order. Expired samples
+    // are skipped by advancing the head, and compacted away once they are the majority.
+    struct Bucket {
+        size_t size() const { return starts.size() - head; }
+
+        void push(double start, uint8_t code, uint8_t confidence, double end, double key) {
+            starts.push_back(start);
+            codes.push_back(code);
+            confidences.push_back(confidence);
+            tightest.push(end, key);
+        }
+
+        void erase_old(double length, double now) {
+            while (head < starts.size() && starts[head] + length <= now)
+                head++;
+            if (head > 32 && 2*head > starts.size()) {
+                starts.erase(starts.begin(), starts.begin() + head);
+                codes.erase(codes.begin(), codes.begin() + head);
+                confidences.erase(confidences.begin(), confidences.begin() + head);
+                head = 0;
+            }
+            tightest.erase_old(now);
+        }
+
+        void clear() {
+            starts.clear();
+            codes.clear();
+            confidences.clear();
+            head = 0;
+            tightest.clear();
+        }
+
+        // Index of the first sample valid as of some time, given the length of the horizon
+        size_t first_as_of(double length, double now) const {
+            return std::partition_point(
+                starts.cbegin() + head, starts.cend(),
+                [length, now](double start) { return start + length <= now; }
+            ) - starts.cbegin();
+        }
+
+        std::vector<double> starts;
+        std::vector<uint8_t> codes, confidences;
+        size_t head = 0;
+        TightestQueue tightest;
+    };
+
+    // Effective bound of one sign. Ranks order the value codes so that a bound conflicts with
+    // every opposite bound of lesser rank, and the tightest bound has the greatest rank.
+    double effective(bool sign, double now) const {
+        const auto rank = [sign](unsigned code) { return sign? kValues - 1 - code: code; };
+
+        double oldest[kConfidences][kValues];
+        for (double (&by_rank)[kValues]: oldest)
+            std::fill(std::begin(by_rank), std::end(by_rank), std::numeric_limits<double>::max());
+        for (unsigned h = 0; h < kHorizons; h++) {
+            const Bucket &bucket = buckets[!sign][h];
+            for (size_t i = bucket.first_as_of(length(h), now); i < bucket.starts.size(); i++) {
+                double &o = oldest[bucket.confidences[i]][rank(bucket.codes[i])];
+                o = std::min(o, bucket.starts[i]);
+            }
+        }
+
+        // Least rank of any opposite bound over the confidences greater than each one, and the
+        // oldest start of any opposite bound with the same confidence and a lesser rank
+        unsigned least_rank_above[kConfidences];
+        unsigned least = kValues;
+        for (unsigned c = kConfidences; c-- > 0;) {
+            least_rank_above[c] = least;
+            for (unsigned r = 0; r < least; r++) {
+                if (oldest[c][r] != std::numeric_limits<double>::max()) {
+                    least = r;
+                    break;
+                }
+            }
+        }
+        double oldest_below[kConfidences][kValues];
+        for (unsigned c = 0; c < kConfidences; c++) {
+            double o = std::numeric_limits<double>::max();
+            for (unsigned r = 0; r < kValues; r++) {
+                oldest_below[c][r] = o;
+                o = std::min(o, oldest[c][r]);
+            }
+        }
+
+        int best = -1;
+        for (unsigned h = 0; h < kHorizons; h++) {
+            const Bucket &bucket = buckets[sign][h];
+            for (size_t i = bucket.first_as_of(length(h), now); i < bucket.starts.size(); i++) {
+                const unsigned c = bucket.confidences[i], r = rank(bucket.codes[i]);
+                const bool keep = least_rank_above[c] >= r && oldest_below[c][r] >= bucket.starts[i];
+                best = keep? std::max<int>(best, r): best;
+            }
+        }
+
+        if (best < 0)
+            return sign? universal_upper.value(): universal_lower.value();
+        return value_lx(rank(best));
+    }
+
+    Bucket buckets[2][kHorizons];  // by sign, then by horizon
+    ClockKind clock = ClockKind::unset;
+};
+
+// Photometer with room for a fixed number of samples stored inline, so that it never allocates,
+// for targets without a heap. Consuming, expiry and estimates each take one pass over the samples
+// per sample. The samples are kept in order of precedence in overrides, by greater confidence and
+// then earlier start, so that an estimate needs no index and no pairwise checks.
+//
+// Estimates are the same as those of Photometer until the samples overflow the capacity. Then
+// the sample with the lowest confidence is evicted, of those the one ending soonest, which is
+// the new sample itself unless a stored one is strictly lower in that order.
+template <size_t kCapacity>
+class StaticPhotometer {
+    static_assert(kCapacity > 0);
+
+public:
+    size_t size() const { return count; }
+    size_t evictions() const { return eviction_count; }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        consume(Sample::from_raw(now, data));
+    }
+
+    void consume(const Sample &sample) {
+        if (sample.should_clear())
+            count = 0;
+        else erase_old(sample.start());
+
+        for (size_t i = 0; i < count; i++) {
+            if (samples[i].is_superset_of(sample))
+                return;
+        }
+
+        if (count == kCapacity) {
+            eviction_count++;
+            size_t victim = 0;
+            for (size_t i = 1; i < count; i++) {
+                if (evicts_before(samples[i], samples[victim]))
+                    victim = i;
+            }
+            if (!evicts_before(samples[victim], sample))
+                return;
+            std::copy(samples.begin() + victim + 1, samples.begin() + count, samples.begin() + victim);
+            count--;
+        }
+
+        // After those that override it if they conflict, which is where its start puts it
+        const size_t at = std::partition_point(
+            samples.begin(), samples.begin() + count,
+            [&sample](const Sample &stored) { return !precedes(sample, stored); }
+        ) - samples.begin();
+        std::copy_backward(samples.begin() + at, samples.begin() + count, samples.begin() + count + 1);
+        samples[at] = sample;
+        count++;
+    }
+
+    double lower() const { return effective(false, -std::numeric_limits<double>::infinity()); }
+    double upper() const { return effective(true, -std::numeric_limits<double>::infinity()); }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        return effective(false, now);
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        return effective(true, now);
+    }
+
+    // No 'now'; all samples considered current
+    double estimate() const {
+        return 0.5*(lower() + upper());
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return 0.5*(lower(now) + upper(now));
+    }
+
+private:
+    // Whether a conflicting sample a would override b
+    static constexpr bool precedes(const Sample &a, const Sample &b) {
+        return a.confidence() > b.confidence()
+            || (a.confidence() == b.confidence() && a.start() < b.start());
+    }
+
+    static constexpr bool evicts_before(const Sample &a, const Sample &b) {
+        return a.confidence() < b.confidence()
+            || (a.confidence() == b.confidence() && a.end() < b.end());
+    }
+
+    void erase_old(double now) {
+        // Same half-open interval as Photometer
+        count = std::remove_if(
+            samples.begin(), samples.begin() + count,
+            [now](const Sample &sample) { return sample.end() <= now; }
+        ) - samples.begin();
+    }
+
+    // The tightest bound of one sign, valid as of now, that no valid opposite bound overrides. The
+    // samples that could override one are those before the samples tied with it in precedence, so
+    // one pass finds every bound in effect, keeping the opposite value that conflicts with most.
+    double effective(bool sign, double now) const {
+        const Sample *effective = sign? &universal_upper: &universal_lower;
+        // Greatest lower value before the current tie when resolving upper bounds, and least upper
+        // value when resolving lower ones
+        double rival = (sign? -1: 1)*std::numeric_limits<double>::infinity();
+        for (size_t first = 0, last; first < count; first = last) {
+            for (last = first; last < count && !precedes(samples[first], samples[last]); last++) {
+                const Sample &bound = samples[last];
+                if (bound.sign() != sign || bound.end() <= now)
+                    continue;
+                if (!(sign? rival > bound.value(): rival < bound.value()))
+                    effective = sign? &effective->resolve_upper(bound): &effective->resolve_lower(bound);
+            }
+            for (size_t i = first; i < last; i++) {
+                const Sample &opposite = samples[i];
+                if (opposite.sign() != sign && opposite.end() > now)
+                    rival = sign? std::max(rival, opposite.value()): std::min(rival, opposite.value());
+            }
+        }
+        return effective->value();
+    }
+
+    template <size_t... I>
+    static constexpr std::array<Sample, kCapacity> vacant(std::index_sequence<I...>) {
+        return { ((void)I, universal_lower)... };
+    }
+
+    std::array<Sample, kCapacity> samples = vacant(std::make_index_sequence<kCapacity>());
+    size_t count = 0, eviction_count = 0;
+};
+
+// Set of value codes as a 256-bit mask, searched a word at a time
+class CodeSet {
+public:
+    static constexpr unsigned kWords = 4;
+
+    void insert(unsigned code) { words[code/64] |= uint64_t(1) << code%64; }
+    void erase(unsigned code) { words[code/64] &= ~(uint64_t(1) << code%64); }
+    bool contains(unsigned code) const { return words[code/64] >> code%64 & 1; }
+    void clear() { std::fill(std::begin(words), std::end(words), 0); }
+
+    bool empty() const {
+        return !(words[0] | words[1] | words[2] | words[3]);
+    }
+
+    CodeSet &operator|=(const CodeSet &other) {
+        for (unsigned w = 0; w < kWords; w++)
+            words[w] |= other.words[w];
+        return *this;
+    }
+
+    // Greatest code no greater than a limit, or -1 if none
+    int highest(unsigned at_most = 255) const {
+        unsigned w = at_most/64;
+        uint64_t word = words[w] & (~uint64_t(0) >> (63 - at_most%64));
+        for (;;) {
+            if (word)
+                return 64*w + 63 - std::countl_zero(word);
+            if (w == 0)
+                return -1;
+            word = words[--w];
+        }
+    }
+
+    // Least code no less than a limit, or 256 if none
+    int lowest(unsigned at_least = 0) const {
+        unsigned w = at_least/64;
+        uint64_t word = words[w] & (~uint64_t(0) << at_least%64);
+        for (;;) {
+            if (word)
+                return 64*w + std::countr_zero(word);
+            if (++w == kWords)
+                return 256;
+            word = words[w];
+        }
+    }
+
+    // Calls f(code) for every code in the set, in ascending order
+    template <typename F>
+    void for_each(F f) const {
+        for (unsigned w = 0; w < kWords; w++) {
+            for (uint64_t word = words[w]; word; word &= word - 1)
+                f(64*w + std::countr_zero(word));
+        }
+    }
+
+private:
+    uint64_t words[kWords] = {};
+};
+
+// Photometer keeping, for each sign and confidence, the set of value codes with samples that are
+// still valid, so that bounds are found with bit scans over 4x2 sets instead of walks over every
+// sample.
+//
+// Within a (sign, confidence, code) key, samples only differ in their start and end. Only their
+// oldest valid start takes part in overrides, and a sample that starts later and ends no later
+// than another of its key never determines it, so each key keeps a run of samples with strictly
+// increasing ends. Estimates are the same as those of Photometer.
+class BitsetPhotometer {
+public:
+    static constexpr unsigned kConfidences = 4, kValues = 256;
+
+    // Number of samples kept, which differs from the samples Photometer keeps: those that cannot
+    // determine their key's oldest start are not kept, but those dominated in Photometer's sense
+    // still are
+    size_t size() const {
+        size_t n = 0;
+        for (unsigned sign = 0; sign < 2; sign++)
+            for (unsigned c = 0; c < kConfidences; c++)
+                active[sign][c].for_each([&](unsigned code) { n += keys[sign][c][code].size(); });
+        return n;
+    }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        const RawSample raw = RawSample::from_bytes(data);
+        const Sample sample(now, raw);
+
+        if (sample.should_clear())
+            clear();
+        else if (now >= next_expiry)
+            erase_old(now);
+
+        // Any sample at least as tight with an end no earlier is a superset. Expired samples end no
+        // later than now, so they cannot be supersets of the new sample.
+        const unsigned code = index(raw.value), sign = raw.sign;
+        CodeSet kept;
+        for (const CodeSet &set: active[sign])
+            kept |= set;
+        for (
+            int r = next_rank(kept, sign, kValues - 1);
+            r >= int(rank(sign, code));
+            r = r > 0? next_rank(kept, sign, r - 1): -1
+        ) {
+            for (unsigned c = 0; c < kConfidences; c++) {
+                const unsigned t = rank(sign, r);
+                if (active[sign][c].contains(t) && keys[sign][c][t].back().end >= sample.end())
+                    return;
+            }
+        }
+
+        Ring<Run> &key = keys[sign][raw.confidence][code];
+        assert(key.empty() || key.back().end < sample.end());
+        key.push_back(Run { .start = now, .end = sample.end() });
+        active[sign][raw.confidence].insert(code);
+        next_expiry = std::min(next_expiry, key.front().end);
+    }
+
+    double lower(
+        double now  // monotonic seconds
+    ) const {
+        return effective(false, now);
+    }
+
+    double upper(
+        double now  // monotonic seconds
+    ) const {
+        return effective(true, now);
+    }
+
+    double estimate(
+        double now  // monotonic seconds
+    ) const {
+        return 0.5*(lower(now) + upper(now));
+    }
+
+private:
+    static constexpr double kNever = std::numeric_limits<double>::infinity();
+
+    struct Run {
+        double start, end;
+    };
+
+    static constexpr unsigned index(int16_t value) { return value + kValues/2; }
+    static constexpr double value_lx(unsigned index) { return kValueLx[index ^ kValues/2]; }
+
+    void clear() {
+        for (unsigned sign = 0; sign < 2; sign++) {
+            for (unsigned c = 0; c < kConfidences; c++) {
+                active[sign][c].for_each([&](unsigned code) { keys[sign][c][code].clear(); });
+                active[sign][c].clear();
+            }
+        }
+        next_expiry = kNever;
+    }
+
+    void erase_old(double now) {
+        next_expiry = kNever;
+        for (unsigned sign = 0; sign < 2; sign++) {
+            for (unsigned c = 0; c < kConfidences; c++) {
+                active[sign][c].for_each([&](unsigned code) {
+                    Ring<Run> &key = keys[sign][c][code];
+                    while (!key.empty() && key.front().end <= now)
+                        key.pop_front();
+                    if (key.empty())
+                        active[sign][c].erase(code);
+                    else next_expiry = std::min(next_expiry, key.front().end);
+                });
+            }
+        }
+    }
+
+    // Oldest start of any sample of a key valid as of now, or infinity if none
+    double oldest(unsigned sign, unsigned c, unsigned code, double now) const {
+        const Ring<Run> &key = keys[sign][c][code];
+        const size_t i = key.partition_point([now](const Run &run) { return run.end <= now; });
+        return i < key.size()? key[i].start: kNever;
+    }
+
+    // Ranks order the value codes so that a bound conflicts with every opposite bound of lesser
+    // rank, and the tightest bound has the greatest rank. Ranks map back to codes the same way.
+    static constexpr unsigned rank(bool sign, unsigned code) {
+        return sign? kValues - 1 - code: code;
+    }
+
+    // Greatest rank in a set no greater than a limit, or -1 if none
+    static int next_rank(const CodeSet &set, bool sign, unsigned at_most) {
+        if (!sign)
+            return set.highest(at_most);
+        const int code = set.lowest(kValues - 1 - at_most);
+        return code < int(kValues)? kValues - 1 - code: -1;
+    }
+
+    // Effective bound of one sign
+    double effective(bool sign, double now) const {
+        // Codes of each sign and confidence with samples valid as of now. Until the earliest
+        // expiry, these are the active codes.
+        CodeSet valid[2][kConfidences];
+        for (unsigned s = 0; s < 2; s++) {
+            for (unsigned c = 0; c < kConfidences; c++) {
+                if (now < next_expiry)
+                    valid[s][c] = active[s][c];
+                else active[s][c].for_each([&](unsigned code) {
+                    if (keys[s][c][code].back().end > now)
+                        valid[s][c].insert(code);
+                });
+            }
+        }
+        const CodeSet (&own)[kConfidences] = valid[sign], (&opposite)[kConfidences] = valid[!sign];
+
+        // Greatest own rank that is tighter than none of the opposite bounds of any confidence
+        // above each one; these conflict with no opposite bound of greater confidence
+        int best = -1;
+        CodeSet above;
+        for (unsigned c = kConfidences; c-- > 0;) {
+            const int least_above = sign? kValues - 1 - above.highest(): above.lowest();
+            above |= opposite[c];
+            if (own[c].empty())
+                continue;
+
+            // Opposite codes of the same confidence in rank order, with the oldest start of each
+            // and of all of lesser rank
+            unsigned ranks[kValues];
+            double oldest_to[kValues];
+            unsigned n = 0;
+            opposite[c].for_each([&](unsigned code) { ranks[n++] = rank(sign, code); });
+            if (sign)
+                std::reverse(ranks, ranks + n);
+            for (unsigned i = 0; i < n; i++) {
+                oldest_to[i] = std::min(
+                    i? oldest_to[i - 1]: kNever, oldest(!sign, c, rank(sign, ranks[i]), now)
+                );
+            }
+
+            // Own codes from the tightest down, until one is older than every conflicting bound
+            for (
+                int r = next_rank(own[c], sign, std::min<int>(kValues - 1, least_above));
+                r > best;
+                r = r > 0? next_rank(own[c], sign, r - 1): -1
+            ) {
+                while (n > 0 && int(ranks[n - 1]) >= r)
+                    n--;
+                if (n == 0 || oldest_to[n - 1] >= oldest(sign, c, rank(sign, r), now)) {
+                    best = r;
+                    break;
+                }
+            }
+        }
+
+        if (best < 0)
+            return sign? universal_upper.value(): universal_lower.value();
+        return value_lx(rank(sign, best));
+    }
+
+    Ring<Run> keys[2][kConfidences][kValues];  // by sign, confidence and value index
+    CodeSet active[2][kConfidences];           // codes with a sample kept, by sign and confidence
+    double next_expiry = kNever;               // earliest end of a kept sample
+};
+
+}
+
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "notifier.hpp"
+#include "photometer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+namespace photometer {
+
+// Coroutine that yields values to one consumer awaiting them, for hosts that run a single-threaded
+// event loop. The body runs only while the consumer awaits next(), up to its next co_yield; when
+// it awaits anything else, control goes back to the loop, which resumes the body once that is
+// done. Exceptions thrown by the body are rethrown from next(). It must not be destroyed while a
+// next() is pending.
+template <typename T>
+class AsyncGenerator {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        // Suspends the body and resumes the consumer waiting in next()
+        struct Transfer {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(Handle body) const noexcept {
+                return body.promise().consumer;
+            }
+            void await_resume() const noexcept { }
+        };
+
+        AsyncGenerator get_return_object() { return AsyncGenerator(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        Transfer final_suspend() const noexcept { return {}; }
+
+        Transfer yield_value(T yielded) {
+            value = std::move(yielded);
+            return {};
+        }
+
+        void return_void() { value.reset(); }
+
+        void unhandled_exception() {
+            value.reset();
+            error = std::current_exception();
+        }
+
+        std::optional<T> value;
+        std::coroutine_handle<> consumer = std::noop_coroutine();
+        std::exception_ptr error;
+    };
+
+    class Next {
+    public:
+        bool await_ready() const noexcept { return body.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) const noexcept {
+            body.promise().consumer = consumer;
+            return body;
+        }
+
+        // The value yielded; empty once the body has returned
+        std::optional<T> await_resume() const {
+            if (body.done()) {
+                if (std::exception_ptr error = std::exchange(body.promise().error, nullptr))
+                    std::rethrow_exception(error);
+                return std::nullopt;
+            }
+            return std::move(body.promise().value);
+        }
+
+    private:
+        friend class AsyncGenerator;
+        explicit Next(Handle body): body(body) { }
+
+        Handle body;
+    };
+
+    AsyncGenerator(AsyncGenerator &&other) noexcept: body(std::exchange(other.body, nullptr)) { }
+
+    AsyncGenerator &operator=(AsyncGenerator &&other) noexcept {
+        std::swap(body, other.body);
+        return *this;
+    }
+
+    ~AsyncGenerator() {
+        if (body)
+            body.destroy();
+    }
+
+    Next next() {
+        assert(body);
+        return Next(body);
+    }
+
+private:
+    explicit AsyncGenerator(Handle body): body(body) { }
+
+    Handle body;
+};
+
+// Frames as received over some interval, in memory owned by the source that produced them
+struct FrameBatch {
+    std::span<const double> timestamps;   // monotonic seconds
+    std::span<const uint8_t[2]> frames;   // raw from the sensor; one per timestamp
+};
+
+// A source's next() returns something movable to co_await for the next batch, as an
+// std::optional<FrameBatch> that is empty at the end of the stream. A batch's memory need only
+// stay valid until next() is called again.
+template <typename Source>
+concept FrameSource = requires(Source &source) { { source.next() } -> std::movable; };
+
+// Drives a meter from a source of frame batches on the host's event loop, and yields each change
+// of its effective bounds:
+//
+//     AsyncGenerator<BoundsChange> changes = frame_pipeline(source, meter);
+//     while (std::optional<BoundsChange> change = co_await changes.next())
+//         publish(*change);
+//
+// Each batch passes through four stages: it is decoded into FrameBlocks; the expiries before its
+// first frame are reported, as ChangeNotifier reports them; its samples are inserted; and the
+// change it made, if any, is reported as of its last frame. Changes between frames of one batch
+// are not reported on their own. A batch is decoded as soon as it arrives, out of the source's
+// memory, and the next one is requested before the other stages run, so that a source that
+// starts reading when asked fills the next batch while the meter resolves this one and the
+// consumer handles its changes. Everything runs on the loop's thread, in steps no longer than one
+// batch, and never blocks: the pipeline waits for frames only by suspending.
+//
+// The source and the meter must outlive the generator. The meter may be read between changes.
+template <typename Policy, typename Stats, FrameSource Source>
+AsyncGenerator<BoundsChange> frame_pipeline(Source &source, BasicPhotometer<Policy, Stats> &meter) {
+    using Meter = BasicPhotometer<Policy, Stats>;
+    std::vector<FrameBlock> blocks;
+    BoundsTracker tracker(Meter::universal_lower.value(), Meter::universal_upper.value());
+    double clock = tracker.current().time;  // of the last check
+    // Whether the bounds as of now differ from the last reported
+    const auto changed = [&](double now) {
+        clock = now;
+        return tracker.update(meter, now);
+    };
+
+    auto pending = source.next();
+    for (;;) {
+        const std::optional<FrameBatch> batch = co_await std::move(pending);
+        if (!batch)
+            break;
+        assert(batch->timestamps.size() == batch->frames.size());
+        const size_t n = batch->frames.size();
+        if (n == 0) {
+            pending = source.next();
+            continue;
+        }
+
+        // Decode
+        blocks.resize((n + FrameBlock::kCapacity - 1)/FrameBlock::kCapacity);
+        for (size_t i = 0; i < n; i += FrameBlock::kCapacity) {
+            blocks[i/FrameBlock::kCapacity].template decode<Policy>(
+                batch->timestamps.data() + i, batch->frames.data() + i,
+                std::min(n - i, FrameBlock::kCapacity)
+            );
+        }
+        const double first = batch->timestamps.front(), now = batch->timestamps.back();
+        pending = source.next();
+
+        // Expiry, up to the first frame; one at that time coincides with it
+        for (double t; (t = meter.next_bounds_change(clock)) < first;) {
+            if (changed(t))
+                co_yield tracker.current();
+        }
+
+        // Insert
+        for (const FrameBlock &block: blocks)
+            meter.consume_block(block);
+
+        // Publish
+        if (changed(now))
+            co_yield tracker.current();
+    }
+}
+
+}
+
+#endif
@@ -1,184 +1,48 @@
-#if __cplusplus < 202002L
-#   warning This program was written for compatibility with c++20 or later.
-#endif
+#include "bank.hpp"
+#include "capture.hpp"
+#include "counting_resource.hpp"
+#include "engines.hpp"
+#include "frame_parser.hpp"
+#include "frame_queue.hpp"
+#include "notifier.hpp"
+#include "photometer.hpp"
+#include "pipeline.hpp"
+#include "snapshot.hpp"
+#include "streams.hpp"
+#include "work_pool.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <coroutine>
 #include <cstdint>
-#include <cstring>
+#include <deque>
 #include <iostream>
-#include <map>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 namespace {
 
-struct RawSample {
-    uint16_t confidence: 2;
-    uint16_t clear: 1;
-    int16_t value: 8;
-    uint16_t sign: 1;
-    uint16_t horizon: 4;
-
-    void dump() const {
-        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(this);
-        std::cout
-            << "meter.consume(now, (const uint8_t[2]){ "
-            << std::hex
-            << "0x" << static_cast<uint16_t>(bytes[0]) << "u, "
-            << "0x" << static_cast<uint16_t>(bytes[1]) << "u });  //"
-            << std::dec
-            << " conf=" << confidence
-            << " clear=" << clear
-            << " value=" << value_lx()
-            << " sign=" << sign
-            << " horizon=" << horizon_s()
-            << "\n";
-    }
-
-    constexpr double value_lx() const {
-        return 50e3 + 390*value;
-    }
-
-    constexpr double horizon_s() const {
-        return 0.0165*(1u << horizon);
-    }
-};
-
-class Sample {
-private:
-    static constexpr size_t kBytes = 2;
-
-public:
-    static constexpr Sample from_raw(
-        double now,                    // monotonic seconds
-        const uint8_t (&data)[kBytes]  // raw from the sensor
-    ) {
-        RawSample raw;
-        static_assert(sizeof(raw) >= kBytes);
-        static_assert(sizeof(raw) <= kBytes);
-        std::memcpy(&raw, data, kBytes);
-        return Sample(now, raw);
-    }
-
-    constexpr Sample(
-        double now,           // monotonic seconds
-        const RawSample &raw  // raw from the sensor
-    ):
-        start_(now),
-        end_(now + raw.horizon_s()),
-        sign_(raw.sign),
-        value_(raw.value_lx()),
-        clear_(raw.clear),
-        confidence_(raw.confidence)
-    { }
-
-    constexpr RawSample raw() const {
-        return RawSample {
-            .confidence = confidence_,
-            .clear = clear_,
-            .value = static_cast<int16_t>((value_ - 50e3)/390),
-            .sign = sign_,
-            .horizon = static_cast<uint16_t>(std::round(
-                std::log((end_ - start_)/0.0165)/std::log(2.)
-            )),
-        };
-    }
-
-    constexpr Sample(bool universal_sign):
-        start_(std::numeric_limits<double>::lowest()),
-        end_(std::numeric_limits<double>::max()),
-        sign_(universal_sign),
-        // If sign is 1, this sample's value is greater than all possible values
-        // If sign is 0, this sample's value is lower than all possible values
-        value_(universal_sign? 100e3: 0.),
-        clear_(false),
-        confidence_(0)
-    { }
-
-    constexpr Sample(
-        double start, double end, bool sign, double value, bool clear, uint8_t confidence
-    ):
-        start_(start), end_(end), sign_(sign), value_(value), clear_(clear), confidence_(confidence)
-    { }
-
-    constexpr double start() const { return start_; }
-    constexpr double end() const { return end_; }
-    constexpr bool should_clear() const { return clear_; }
-    constexpr double value() const { return value_; }
-    constexpr bool sign() const { return sign_; }
-    constexpr uint8_t confidence() const { return confidence_; }
-
-    constexpr bool conflicts(const Sample &other) const {
-        return
-            (
-                // gt           lt
-                sign_ && !other.sign_ &&
-                value_ < other.value_
-            ) ||
-            (
-                // lt           gt
-                !sign_ && other.sign_ &&
-                value_ > other.value_
-            );
-    }
-
-    constexpr bool is_superset_of(const Sample &other) const {
-        return end_ >= other.end_
-            && (
-                // upper bound superset
-                (sign_ && other.sign_ && value_ <= other.value_) ||
-                // lower bound superset
-                (!sign_ && !other.sign_ && value_ >= other.value_)
-            );
-    }
-
-    constexpr bool overrides(const Sample &other) const {
-        if (conflicts(other)) {
-            return confidence_ > other.confidence_
-                || (confidence_ == other.confidence_ && start_ < other.start_);
-        }
-        else return false;
-    }
-
-    constexpr const Sample &resolve_lower(const Sample &other) const {
-        // Only narrow the range by preferring the greater lower bound
-        return value_ > other.value_? *this: other;
-    }
-
-    constexpr const Sample &resolve_upper(const Sample &other) const {
-        // Only narrow the range by preferring the lesser upper bound
-        return value_ < other.value_? *this: other;
-    }
-
-private:
-    double start_, end_;
-    bool sign_;
-    double value_;
-    bool clear_;
-    uint8_t confidence_;
-};
-
-constexpr static const Sample universal_lower(false), universal_upper(true);
+using namespace photometer;
 
+constexpr bool is_close(double a, double b, double epsilon = 1e-12) {
+    return std::abs(a - b) < epsilon;
+}
 
-class Photometer {
+// Direct transcription of the Photometer semantics with no indexing, against which the optimised
+// implementations are validated
+class ModelPhotometer {
 public:
-    Photometer() = default;
-
-    Photometer(const Photometer &current, double future):
-        lower_by_end(
-            current.lower_by_end.upper_bound(future),
-            current.lower_by_end.cend()
-        ),
-        upper_by_end(
-            current.upper_by_end.upper_bound(future),
-            current.upper_by_end.cend()
-        )
-    { }
-
-    size_t size() const { return lower_by_end.size() + upper_by_end.size(); }
-
     void consume(
         double now,               // monotonic seconds
         const uint8_t (&data)[2]  // raw from the sensor
@@ -187,94 +51,102 @@ public:
     }
 
     void consume(const Sample &sample) {
-        if (sample.should_clear()) {
-            lower_by_end.clear();
-            upper_by_end.clear();
+        if (sample.should_clear())
+            samples.clear();
+        else {
+            std::erase_if(
+                samples,
+                [&sample](const Sample &other) { return other.end() <= sample.start(); }
+            );
         }
-        else erase_old(sample.start());
-
-        MapT &target = sample.sign()? upper_by_end: lower_by_end;
 
-        MapT::const_iterator subset_of = std::find_if(
-            target.cbegin(),
-            target.cend(),
-            [sample](const std::pair<const double, Sample> &other) {
-                return other.second.is_superset_of(sample);
-            }
-        );
-        if (subset_of == target.cend())
-            target.emplace(sample.end(), sample);
+        if (std::none_of(
+            samples.cbegin(), samples.cend(),
+            [&sample](const Sample &other) { return other.is_superset_of(sample); }
+        ))
+            samples.push_back(sample);
     }
 
-    double lower() const {
+    double lower(double now) const {
         const Sample *effective_lower = &universal_lower;
-        for (const std::pair<const double, Sample> &kvl: lower_by_end) {
+        for (const Sample &l: samples) {
+            if (l.sign() || l.end() <= now) continue;
             bool keep = true;
-            // This is O(n2): we can do better, but for now this is simple to implement and validate
-            for (const std::pair<const double, Sample> &kvu: upper_by_end) {
-                if (kvu.second.overrides(kvl.second)) {
+            for (const Sample &u: samples) {
+                if (u.sign() && u.end() > now && u.overrides(l)) {
                     keep = false;
                     break;
                 }
             }
             if (keep)
-                effective_lower = &effective_lower->resolve_lower(kvl.second);
+                effective_lower = &effective_lower->resolve_lower(l);
         }
         return effective_lower->value();
     }
 
-    double upper() const {
+    double upper(double now) const {
         const Sample *effective_upper = &universal_upper;
-        for (const std::pair<const double, Sample> &kvu: upper_by_end) {
+        for (const Sample &u: samples) {
+            if (!u.sign() || u.end() <= now) continue;
             bool keep = true;
-            // This is O(n2): we can do better, but for now this is simple to implement and validate
-            for (const std::pair<const double, Sample> &kvl: lower_by_end) {
-                if (kvl.second.overrides(kvu.second)) {
+            for (const Sample &l: samples) {
+                if (!l.sign() && l.end() > now && l.overrides(u)) {
                     keep = false;
                     break;
                 }
             }
             if (keep)
-                effective_upper = &effective_upper->resolve_upper(kvu.second);
+                effective_upper = &effective_upper->resolve_upper(u);
         }
         return effective_upper->value();
     }
 
-    // No 'now'; all samples considered current
-    double estimate() const {
-        return 0.5*(lower() + upper());
+    double estimate(double now) const {
+        return 0.5*(lower(now) + upper(now));
     }
 
-    double estimate(
-        double now  // monotonic seconds
-    ) const {
-        Photometer as_of(*this, now);
-        return as_of.estimate();
+private:
+    std::vector<Sample> samples;
+};
+
+// Pseudo-random frames concentrated on a few values, so that conflicts and overrides are common
+class FrameGenerator {
+public:
+    explicit FrameGenerator(
+        unsigned seed,
+        unsigned max_horizon = 7,          // HRZ upper limit
+        unsigned clear_one_in = 0,         // 0 for no CLR
+        bool split_confidence = false      // lower bounds only even confidences, upper only odd
+    ):
+        gen(seed), max_horizon(max_horizon), clear_one_in(clear_one_in),
+        split_confidence(split_confidence)
+    { }
+
+    void next(uint8_t (&data)[2]) {
+        const unsigned
+            sign = std::uniform_int_distribution<unsigned>(0, 1)(gen),
+            confidence = split_confidence
+                ? (std::uniform_int_distribution<unsigned>(0, 1)(gen) << 1 | sign)
+                : std::uniform_int_distribution<unsigned>(0, 3)(gen),
+            clear = clear_one_in && std::uniform_int_distribution<unsigned>(1, clear_one_in)(gen) == 1,
+            value = std::uniform_int_distribution<unsigned>(0, 15)(gen)*16 - 128,
+            horizon = std::uniform_int_distribution<unsigned>(0, max_horizon)(gen);
+        const uint16_t word = (confidence | clear << 2 | (value & 0xff) << 3 | sign << 11 | horizon << 12);
+        data[0] = word & 0xff;
+        data[1] = word >> 8;
     }
 
-private:
-    typedef std::multimap<double, Sample> MapT;
-
-    void erase_old(double now) {
-        // Erase samples with ends up to and including now
-        // This uses a half-open interval
-        lower_by_end.erase(
-            lower_by_end.cbegin(),
-            lower_by_end.upper_bound(now)
-        );
-        upper_by_end.erase(
-            upper_by_end.cbegin(),
-            upper_by_end.upper_bound(now)
-        );
+    // Usually advance by a frame period, but sometimes repeat the same timestamp
+    double advance(double now) {
+        return std::uniform_int_distribution<unsigned>(0, 3)(gen)? now + 1e-3: now;
     }
 
-    MapT lower_by_end, upper_by_end;
+private:
+    std::mt19937 gen;
+    unsigned max_horizon, clear_one_in;
+    bool split_confidence;
 };
 
-constexpr bool is_close(double a, double b, double epsilon = 1e-12) {
-    return std::abs(a - b) < epsilon;
-}
-
 void test_serialise() {
     std::cout << "test_serialise\n";
     RawSample samp {
@@ -284,13 +156,56 @@ void test_serialise() {
         .sign = 0,
         .horizon = 0b0101,
     };
-    const uint8_t *raw = reinterpret_cast<const uint8_t*>(&samp);
+    const std::array<uint8_t, 2> raw = samp.to_bytes();
     assert(raw[0] == 0b10000010u);
     assert(raw[1] == 0b01010111u);
 
     samp.dump();
 }
 
+void test_decode_all() {
+    std::cout << "test_decode_all\n";
+    static_assert(RawSample::from_bytes({ 0b10000010u, 0b01010111u }).value == -16);
+    static_assert(RawSample::from_bytes({ 0b10000010u, 0b01010111u }).horizon_s() == 0.0165*32);
+
+    std::vector<double> timestamps;
+    std::vector<std::array<uint8_t, 2>> frames;
+    for (unsigned word = 0; word < 0x10000; word++) {
+        const uint8_t data[2] = {
+            static_cast<uint8_t>(word & 0xff), static_cast<uint8_t>(word >> 8)
+        };
+        const RawSample raw = RawSample::from_bytes(data);
+        assert(raw.confidence == (word & 0x3));
+        assert(raw.clear == (word >> 2 & 0x1));
+        assert(raw.value == static_cast<int8_t>(word >> 3));
+        assert(raw.sign == (word >> 11 & 0x1));
+        assert(raw.horizon == word >> 12);
+        assert(raw.to_bytes()[0] == data[0] && raw.to_bytes()[1] == data[1]);
+        assert(raw.value_lx() == 50e3 + 390*raw.value);
+        assert(raw.horizon_s() == 0.0165*(1u << raw.horizon));
+        timestamps.push_back(word*1e-4);
+        frames.push_back({ data[0], data[1] });
+    }
+
+    FrameBlock block;
+    for (size_t i = 0; i < frames.size(); i += FrameBlock::kCapacity) {
+        block.decode(
+            timestamps.data() + i,
+            reinterpret_cast<const uint8_t (*)[2]>(frames.data() + i),
+            FrameBlock::kCapacity
+        );
+        for (size_t j = 0; j < block.count; j++) {
+            const Sample
+                expected = Sample::from_raw(timestamps[i + j], { frames[i + j][0], frames[i + j][1] }),
+                actual = block.sample(j);
+            assert(actual.start() == expected.start() && actual.end() == expected.end());
+            assert(actual.value() == expected.value() && actual.sign() == expected.sign());
+            assert(actual.should_clear() == expected.should_clear());
+            assert(actual.confidence() == expected.confidence());
+        }
+    }
+}
+
 void test_deserialise() {
     std::cout << "test_deserialise\n";
     double now = 0.5;
@@ -307,18 +222,20 @@ void test_deserialise() {
     assert(samp.confidence() == 0b10u);
 }
 
+template <typename Meter>
 void test_empty() {
     std::cout << "test_empty\n";
-    Photometer meter;
+    Meter meter;
     assert(meter.size() == 0);
     assert(is_close(meter.estimate(0), 50e3));
     assert(is_close(meter.estimate(), 50e3));
 }
 
+template <typename Meter>
 void test_simple_lower() {
     std::cout << "test_simple_lower\n";
     // Single sample
-    Photometer meter;
+    Meter meter;
     Sample samp0(1.1, 1.5, false, 65e3, false, 0);
     meter.consume(samp0);
     samp0.raw().dump();
@@ -356,10 +273,11 @@ void test_simple_lower() {
     assert(is_close(meter.estimate(2.5), 50e3));
 }
 
+template <typename Meter>
 void test_simple_upper() {
     std::cout << "test_simple_upper\n";
     // Single sample
-    Photometer meter;
+    Meter meter;
     Sample samp0(1.1, 1.5, true, 40e3, false, 0);
     meter.consume(samp0);
     samp0.raw().dump();
@@ -397,9 +315,10 @@ void test_simple_upper() {
     assert(is_close(meter.estimate(2.5), 50e3));
 }
 
+template <typename Meter>
 void test_superset() {
     std::cout << "test_superset\n";
-    Photometer meter;
+    Meter meter;
 
     Sample sampl(1.1, 1.5, false, 0, false, 0);
     meter.consume(sampl);
@@ -417,9 +336,10 @@ void test_superset() {
     assert(is_close(meter.estimate(1.3), 20e3));
 }
 
+template <typename Meter>
 void test_double_bound() {
     std::cout << "test_double_bound\n";
-    Photometer meter;
+    Meter meter;
     Sample samp0(1.0, 1.5, false, 20e3, false, 0);
     meter.consume(samp0);
     samp0.raw().dump();
@@ -430,9 +350,10 @@ void test_double_bound() {
     assert(is_close(meter.estimate(1.1), 30e3));
 }
 
+template <typename Meter>
 void test_override_confidence() {
     std::cout << "test_override_confidence\n";
-    Photometer meter;
+    Meter meter;
     // Second one wins
     Sample samp0(1.0, 2.0, false, 40e3, false, 0);
     meter.consume(samp0);
@@ -456,9 +377,10 @@ void test_override_confidence() {
     assert(is_close(meter.estimate(3.7), 70e3));
 }
 
+template <typename Meter>
 void test_override_time() {
     std::cout << "test_override_time\n";
-    Photometer meter;
+    Meter meter;
     // First one wins
     Sample samp0(1.0, 2.0, false, 60e3, false, 2);
     meter.consume(samp0);
@@ -470,6 +392,1491 @@ void test_override_time() {
     assert(is_close(meter.estimate(1.2), 80e3));
 }
 
+void test_as_of() {
+    std::cout << "test_as_of\n";
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<unsigned> byte(0, 0xff);
+    Photometer meter;
+    double now = 0;
+    for (int i = 0; i < 2000; i++) {
+        now += 1e-3;
+        uint8_t data[2] = {
+            static_cast<uint8_t>(byte(gen) & ~0x04u),  // no CLR
+            static_cast<uint8_t>(byte(gen) & 0x7fu),   // HRZ <= 7
+        };
+        meter.consume(now, data);
+        if (i % 50 == 0) {
+            for (double future: {now, now + 0.1, now + 1., now + 10.}) {
+                // Must match the copying implementation that drops expired samples up front
+                Photometer copy(meter, future);
+                assert(meter.estimate(future) == copy.estimate());
+                assert(meter.lower(future) == copy.lower());
+                assert(meter.upper(future) == copy.upper());
+            }
+        }
+    }
+}
+
+void test_model() {
+    std::cout << "test_model\n";
+    for (unsigned seed = 0; seed < 8; seed++) {
+        FrameGenerator frames(seed, 8, seed % 2? 300: 0);
+        Photometer meter;
+        ModelPhotometer model;
+        double now = 0;
+        for (int i = 0; i < 1500; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            model.consume(now, data);
+            for (double future: {now, now + 0.05, now + 0.5}) {
+                assert(meter.lower(future) == model.lower(future));
+                assert(meter.upper(future) == model.upper(future));
+            }
+        }
+    }
+}
+
+void test_dominance() {
+    std::cout << "test_dominance\n";
+    Photometer meter;
+    // Rising confidence at the same value makes older samples redundant
+    for (uint8_t confidence = 0; confidence < 4; confidence++) {
+        meter.consume(Sample(1.0 + confidence*0.1, 5.0 + confidence, false, 40e3, false, confidence));
+        assert(meter.size() == 1);
+    }
+    assert(is_close(meter.estimate(1.5), 70e3));
+
+    // A rising lower bound does not make the older one redundant: it still applies when the newer
+    // one is overridden by an upper bound that does not conflict with the older one
+    Photometer rising;
+    rising.consume(Sample(1.0, 5.0, false, 40e3, false, 0));
+    rising.consume(Sample(1.1, 5.1, false, 60e3, false, 0));
+    rising.consume(Sample(1.2, 5.2, true, 50e3, false, 1));
+    assert(rising.size() == 3);
+    assert(is_close(rising.lower(1.5), 40e3));
+    assert(is_close(rising.estimate(1.5), 45e3));
+
+    // Copies keep working after the source changes
+    Photometer copy(rising);
+    rising.consume(Sample(1.3, 1.4, false, 0, true, 0));
+    copy.consume(Sample(1.3, 5.0, false, 30e3, false, 0));
+    assert(copy.size() == 3);
+    assert(is_close(copy.estimate(1.5), 45e3));
+}
+
+void test_expiry_budget() {
+    std::cout << "test_expiry_budget\n";
+    // A burst of short samples, then one more after they have all expired
+    Photometer meter;
+    meter.set_expiry_budget(2);
+    for (int i = 0; i < 10; i++)
+        meter.consume(Sample(1.0 + i*1e-3, 1.1 + i*1e-3, false, 40e3 - i*100, false, 0));
+    assert(meter.size() == 10);
+    meter.consume(Sample(5.0, 6.0, true, 60e3, false, 0));
+    assert(meter.size() == 9);
+    assert(meter.lower(5.0) == 0 && meter.lower() == 0);
+    assert(meter.estimate(1.05) == 30e3);  // expired as of 5.0, so ignored even for earlier times
+    assert(meter.next_change_time() == 6.0);
+    meter.consume(Sample(5.1, 6.1, true, 60e3, false, 0));
+    assert(meter.size() == 8);
+
+    // Copies, including those as of a time before the expiry, ignore the same samples
+    const Photometer copy(meter), future(meter, 1.05);
+    assert(copy.size() == 8 && future.size() == 2);
+    assert(copy.estimate(1.05) == 30e3 && future.estimate(1.05) == 30e3);
+
+    // Batches reclaim the budget for each of their frames, so the backlog stays bounded even when
+    // every frame of a batch larger than the budget expires by the next
+    {
+        Photometer batched, blocked;
+        batched.set_expiry_budget(16);
+        blocked.set_expiry_budget(16);
+        double timestamps[256];
+        uint8_t frames[256][2];
+        FrameBlock block;
+        for (int b = 0; b < 400; b++) {
+            for (int i = 0; i < 256; i++) {
+                timestamps[i] = (256*b + i)*1e-4;
+                frames[i][0] = 0x00u;  // conf=0 clear=0 value=50000 sign=0 horizon=0.0165
+                frames[i][1] = 0x00u;
+            }
+            batched.consume_batch(timestamps, frames, 256);
+            block.decode(timestamps, frames, 256);
+            blocked.consume_block(block);
+            assert(batched.size() <= 2*256 && blocked.size() <= 2*256);
+        }
+    }
+
+    for (unsigned seed = 0; seed < 6; seed++) {
+        FrameGenerator frames(seed, seed < 3? 6: 12, seed % 2? 300: 0);
+        Photometer unlimited, budgeted;
+        budgeted.set_expiry_budget(1 + seed % 3);
+        std::vector<double> a, b;
+        double now = 0;
+        for (int i = 0; i < 4000; i++) {
+            // Quiet periods let many samples expire at once
+            now = i % 500 == 499? now + 2: frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            unlimited.consume(now, data);
+            budgeted.consume(now, data);
+            assert(budgeted.size() >= unlimited.size());
+            for (double t: {now - 0.5, now - 1e-3, now, now + 0.01, now + 1.})
+                assert(budgeted.estimate(t) == unlimited.estimate(t));
+            assert(budgeted.next_change_time() == unlimited.next_change_time());
+            if (i % 100 == 0) {
+                a.resize(Photometer::series_size(now - 1, now + 1, 1e-2));
+                b.resize(a.size());
+                unlimited.estimate_series(now - 1, now + 1, 1e-2, a.data());
+                budgeted.estimate_series(now - 1, now + 1, 1e-2, b.data());
+                assert(a == b);
+            }
+        }
+    }
+}
+
+template <typename Meter>
+void test_ticks_on() {
+    // In seconds, the end of a sample need not be the exact sum of its start and horizon, so
+    // whether it has expired at that sum depends on rounding. In ticks it has, exactly.
+    const uint8_t lower[2] = { 0x30u, 0x21u };  // conf=0 clear=0 value=64820 sign=0 horizon=0.066
+    const uint64_t start = 123456789012345;
+    Meter meter;
+    meter.consume(Ticks(start), lower);
+    assert(meter.size() == 1);
+    assert(meter.estimate(Ticks(start)) == 0.5*(64820 + 100e3));
+    assert(meter.estimate(Ticks(start + 659999)) == 0.5*(64820 + 100e3));
+    assert(meter.lower(Ticks(start + 660000)) == 0);
+    assert(meter.estimate(Ticks(start + 660000)) == 50e3);
+
+    // Expiry on consume follows the same boundary
+    meter.consume(Ticks(start + 659999), (const uint8_t[2]){ 0x1u, 0x08u });  // conf=1 clear=0 value=50000 sign=1 horizon=0.0165
+    assert(meter.size() == 2);
+    assert(meter.upper(Ticks(start + 659999)) == 50e3);
+    meter.consume(Ticks(start + 660000), (const uint8_t[2]){ 0x1u, 0x08u });
+    assert(meter.size() == 2);
+    assert(meter.lower(Ticks(start + 660000)) == 0);
+}
+
+void test_ticks() {
+    std::cout << "test_ticks\n";
+    static_assert(kHorizonTicks[0]*kTickS == 0.0165 && kHorizonTicks[15] == 5406720000);
+    test_ticks_on<Photometer>();
+    test_ticks_on<PackedPhotometer>();
+}
+
+// DimbulbPolicy with every horizon doubled and values on another scale, so that a meter over it
+// fed the same frames at twice the times agrees with Photometer up to the value mapping
+struct CalibratedPolicy {
+    static constexpr double kValueOffsetLx = 20e3, kValueStepLx = 150;
+    static constexpr double kHorizonS = 0.033;
+    static constexpr uint64_t kHorizonTicks = 330000;
+    static constexpr double kUniversalLowerLx = 0, kUniversalUpperLx = 40e3;
+};
+
+void test_policy() {
+    std::cout << "test_policy\n";
+    using Tables = SensorTables<CalibratedPolicy>;
+    static_assert(Tables::kValueLx[0x7f] == 39050 && Tables::kValueLx[0x80] == 800);
+    static_assert(Tables::kHorizonS[0] == 2*kHorizonS[0] && Tables::kHorizonTicks[15] == 2*kHorizonTicks[15]);
+
+    const uint8_t data[2] = { 0x30u, 0x21u };  // conf=0 clear=0 value=64820 sign=0 horizon=0.066
+    constexpr BasicSample<CalibratedPolicy> sample =
+        BasicSample<CalibratedPolicy>::from_raw(1.0, { 0x30u, 0x21u });
+    static_assert(sample.value() == 20e3 + 150*38 && sample.end() == 1.0 + 0.132);
+    assert(sample.raw().to_bytes()[0] == data[0] && sample.raw().to_bytes()[1] == data[1]);
+    assert(RawSample::from_bytes(data).value_lx<CalibratedPolicy>() == sample.value());
+
+    const auto calibrated = [](double lx) {
+        if (lx == universal_lower.value())
+            return CalibratedPolicy::kUniversalLowerLx;
+        if (lx == universal_upper.value())
+            return CalibratedPolicy::kUniversalUpperLx;
+        return Tables::kValueLx[std::lround((lx - 50e3)/390) & 0xff];
+    };
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 8, seed % 2? 300: 0);
+        Photometer meter;
+        BasicPhotometer<CalibratedPolicy> other;
+        double now = 0;
+        double timestamps[100];
+        uint8_t block[100][2];
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            frames.next(block[i % 100]);
+            timestamps[i % 100] = 2*now;
+            meter.consume(now, block[i % 100]);
+            if (i % 100 == 99) {
+                other.consume_batch(timestamps, block, 100);
+                for (double future: {now, now + 0.05, now + 1.0}) {
+                    assert(other.lower(2*future) == calibrated(meter.lower(future)));
+                    assert(other.upper(2*future) == calibrated(meter.upper(future)));
+                }
+            }
+        }
+    }
+}
+
+void test_stats() {
+    std::cout << "test_stats\n";
+    static_assert(InstrumentedPhotometer::kKeepsStats && !Photometer::kKeepsStats);
+    InstrumentedPhotometer meter;
+    assert(meter.stats().frames == 0 && meter.stats().consume_ns.total() == 0);
+
+    meter.consume(Sample(1.0, 2.0, false, 40e3, false, 0));
+    meter.consume(Sample(1.1, 1.5, false, 30e3, false, 0));  // subset of the first
+    meter.consume(Sample(1.2, 1.4, true, 20e3, false, 1));   // overrides the first
+    assert(is_close(meter.estimate(1.3), 10e3));
+    assert(is_close(meter.estimate(1.35), 10e3));  // served from the cache
+    meter.consume(Sample(1.6, 1.7, true, 90e3, false, 0));   // the upper bound at 1.4 expires
+    meter.consume(Sample(1.8, 1.9, false, 10e3, true, 0));   // CLR
+    {
+        const PhotometerStats &stats = meter.stats();
+        assert(stats.frames == 5);
+        assert(stats.clears == 1);
+        assert(stats.rejected == 1);
+        assert(stats.expired == 1);
+        assert(stats.overridden == 1);
+        assert(stats.resolutions == 1);
+        assert(stats.peak_size == 2);
+        assert(stats.consume_ns.total() == 5);
+        assert(stats.estimate_ns.total() == 2);
+        assert(stats.consume_ns.quantile_ns(0.5) > 0);
+    }
+
+    uint8_t frames[3][2] = { { 0x4u, 0x0u }, { 0x0u, 0x0u }, { 0x4u, 0x0u } };
+    const double timestamps[3] = { 2, 2, 2 };
+    meter.reset_stats();
+    meter.consume_batch(timestamps, frames, 3);
+    assert(meter.stats().frames == 3 && meter.stats().clears == 2);
+    assert(meter.stats().consume_ns.total() == 1);
+
+    LatencyHistogram histogram;
+    assert(histogram.quantile_ns(0.5) == 0);
+    for (uint64_t ns: {0, 1, 3, 900, 1000, 1023})
+        histogram.record(ns);
+    histogram.record(UINT64_MAX);
+    assert(histogram.counts[0] == 2 && histogram.counts[1] == 1 && histogram.counts[9] == 3);
+    assert(histogram.counts[LatencyHistogram::kBuckets - 1] == 1);
+    assert(histogram.quantile_ns(0.5) == 1024);
+    assert(histogram.quantile_ns(1) == UINT64_MAX);
+}
+
+void test_next_change() {
+    std::cout << "test_next_change\n";
+    Photometer meter;
+    assert(meter.next_change_time() == std::numeric_limits<double>::infinity());
+
+    meter.consume(Sample(1.0, 2.0, false, 40e3, false, 0));
+    meter.consume(Sample(1.1, 1.5, true, 20e3, false, 1));
+    assert(meter.next_change_time() == 1.5);
+    assert(is_close(meter.estimate(1.2), 10e3));
+    assert(is_close(meter.estimate(1.4999), 10e3));
+    assert(meter.next_change_time() == 1.5);
+
+    // The overriding upper bound expires, and with it the cached estimate. Estimates do not move
+    // the time from which next_change_time() looks.
+    assert(is_close(meter.estimate(1.5), 70e3));
+    assert(meter.next_change_time() == 1.5);
+    assert(meter.next_change_time(1.5) == 2.0);
+    assert(is_close(meter.estimate(1.2), 10e3));
+    assert(is_close(meter.estimate(1.9), 70e3));
+
+    // Consuming invalidates the cache
+    meter.consume(Sample(1.9, 2.5, false, 60e3, false, 0));
+    assert(is_close(meter.estimate(1.95), 80e3));
+    assert(meter.next_change_time() == 2.0);
+    assert(is_close(meter.estimate(2.2), 80e3));
+    assert(meter.next_change_time(2.2) == 2.5);
+    assert(is_close(meter.estimate(2.5), 50e3));
+    assert(meter.next_change_time(2.5) == std::numeric_limits<double>::infinity());
+
+    // The bounds only change when a bound expires or an overridden one comes back into effect
+    Photometer overridden;
+    overridden.consume(Sample(1.0, 2.0, false, 40e3, false, 0));
+    overridden.consume(Sample(1.1, 1.5, true, 20e3, false, 1));  // overrides the first
+    overridden.consume(Sample(1.2, 1.3, false, 45e3, false, 0));  // also overridden until it ends
+    assert(overridden.next_change_time(1.25) == 1.3);
+    assert(overridden.next_bounds_change(1.25) == 1.5);
+    assert(overridden.next_bounds_change(1.5) == 2.0);
+    assert(overridden.next_bounds_change(2.0) == std::numeric_limits<double>::infinity());
+}
+
+template <typename Meter>
+void test_notifier_against() {
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 8, seed % 2? 300: 0);
+        ChangeNotifier<Meter> notifier;
+        Meter meter;
+        std::vector<BoundsChange> changes;
+        notifier.subscribe([&changes](const BoundsChange &change) { changes.push_back(change); });
+
+        // Between reports, the bounds must stay as last reported
+        const auto check = [&](double t) {
+            notifier.advance(t);
+            assert(notifier.current().lower == meter.lower(t));
+            assert(notifier.current().upper == meter.upper(t));
+        };
+        double now = 0;
+        for (int i = 0; i < 2000; i++) {
+            const double next = frames.advance(now);
+            for (double t: {now + 0.25*(next - now), now + 0.75*(next - now)})
+                check(t);
+            if (notifier.next_deadline() < next)
+                check(notifier.next_deadline());
+            now = next;
+            uint8_t data[2];
+            frames.next(data);
+            notifier.consume(now, data);
+            meter.consume(now, data);
+            check(now);
+            // A deadline kept from before the frame may be early, but never late
+            if constexpr (requires { meter.next_bounds_change(now); })
+                assert(notifier.next_deadline() <= meter.next_bounds_change(now));
+        }
+        check(now + 1e4);
+
+        assert(!changes.empty());
+        for (size_t i = 1; i < changes.size(); i++) {
+            assert(changes[i].time >= changes[i - 1].time);
+            assert(changes[i].lower != changes[i - 1].lower || changes[i].upper != changes[i - 1].upper);
+        }
+        assert(changes.back().lower == 0 && changes.back().upper == 100e3);
+    }
+}
+
+void test_notifier() {
+    std::cout << "test_notifier\n";
+    ChangeNotifier<> notifier;
+    std::vector<BoundsChange> changes;
+    const size_t id =
+        notifier.subscribe([&changes](const BoundsChange &change) { changes.push_back(change); });
+    assert(notifier.next_deadline() == std::numeric_limits<double>::infinity());
+
+    const uint8_t lower[2] = { 0x30u, 0x21u };  // conf=0 clear=0 value=64820 sign=0 horizon=0.066
+    notifier.consume(1.0, lower);
+    assert(changes.size() == 1);
+    assert(changes[0].time == 1.0 && changes[0].lower == 64820 && changes[0].upper == 100e3);
+    assert(changes[0].estimate == 0.5*(64820 + 100e3));
+
+    // A repeat extends the bound without changing it, so nothing is reported. It cannot bring the
+    // next change forward, so the deadline stays at the first copy expiring, which then turns out
+    // not to change the bounds, and the wakeup finds the real deadline.
+    notifier.consume(1.01, lower);
+    assert(changes.size() == 1);
+    assert(notifier.next_deadline() == 1.0 + kHorizonS[2]);
+    notifier.advance(1.07);
+    assert(changes.size() == 1);
+    assert(notifier.next_deadline() == 1.01 + kHorizonS[2]);
+
+    // The expiry is reported by the timer, at the time it took effect
+    notifier.advance(2.0);
+    assert(changes.size() == 2);
+    assert(changes[1].time == 1.01 + kHorizonS[2] && changes[1].lower == 0 && changes[1].estimate == 50e3);
+
+    // Without the timer, on the next frame, before that frame's own change
+    notifier.consume(3.0, lower);
+    notifier.consume(3.1, (const uint8_t[2]){ 0x1u, 0x08u });  // conf=1 clear=0 value=50000 sign=1 horizon=0.0165
+    assert(changes.size() == 5);
+    assert(changes[3].time == 3.0 + kHorizonS[2] && changes[3].lower == 0);
+    assert(changes[4].time == 3.1 && changes[4].upper == 50e3);
+
+    notifier.unsubscribe(id);
+    notifier.advance(4.0);
+    assert(changes.size() == 5 && notifier.current().upper == 100e3);
+
+    test_notifier_against<Photometer>();
+    test_notifier_against<PackedPhotometer>();
+
+    // On a steady stream, most expiries leave the bounds as they were, and the timer skips them
+    ChangeNotifier<InstrumentedPhotometer> steady;
+    Photometer meter;
+    size_t expiries = 0, wakeups = 0, reports = 0;
+    steady.subscribe([&reports](const BoundsChange &) { reports++; });
+    const std::vector<streams::Frame> frames = streams::generate(streams::scenarios[0]);
+    for (const streams::Frame &frame: frames) {
+        for (double t = 0; (t = meter.next_change_time(t)) < frame.now;)
+            expiries++;
+        for (; steady.next_deadline() < frame.now; wakeups++)
+            steady.advance(steady.next_deadline());
+        steady.consume(frame.now, frame.data);
+        meter.consume(frame.now, frame.data);
+        assert(steady.current().lower == meter.lower(frame.now));
+        assert(steady.current().upper == meter.upper(frame.now));
+        assert(steady.next_deadline() <= meter.next_bounds_change(frame.now));
+    }
+    // Only wakeups and the frames whose sample may change the bounds resolve them, which is few
+    // more than change them; both bounds come from one resolution, and the deadline from one sweep
+    const PhotometerStats &stats = steady.meter().stats();
+    assert(stats.resolutions == stats.sweeps && stats.resolutions >= reports + wakeups);
+    assert(stats.resolutions < 2*(reports + wakeups) && 100*stats.resolutions < frames.size());
+    assert(expiries > 100 && 10*wakeups < expiries);
+}
+
+// Coroutine that runs as soon as it is called, for driving tests from a plain function
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Source of frame batches of given sizes that completes each read on a later turn of an event
+// loop, as I/O would
+class ScriptedSource {
+public:
+    using Loop = std::deque<std::coroutine_handle<>>;
+
+    struct Read {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> reader) const { source->loop.push_back(reader); }
+        std::optional<FrameBatch> await_resume() const { return source->deliver(); }
+
+        ScriptedSource *source;
+    };
+
+    ScriptedSource(
+        Loop &loop, const std::vector<double> &timestamps, const std::vector<uint8_t> &bytes,
+        std::vector<size_t> sizes
+    ): loop(loop), timestamps(timestamps), bytes(bytes), sizes(std::move(sizes)) { }
+
+    Read next() {
+        requests++;
+        return Read { .source = this };
+    }
+
+    size_t requests = 0, delivered = 0, offset = 0, last_size = 0;
+
+private:
+    std::optional<FrameBatch> deliver() {
+        if (delivered == sizes.size())
+            return std::nullopt;
+        const size_t n = sizes[delivered++];
+        const FrameBatch batch {
+            .timestamps = std::span(timestamps).subspan(offset, n),
+            .frames = std::span(reinterpret_cast<const uint8_t (*)[2]>(bytes.data()) + offset, n),
+        };
+        offset += n;
+        last_size = n;
+        return batch;
+    }
+
+    Loop &loop;
+    const std::vector<double> &timestamps;
+    const std::vector<uint8_t> &bytes;
+    std::vector<size_t> sizes;
+};
+
+// Consumer of a pipeline's changes, noting how many frames the source had delivered as of each.
+// Everything it uses is a parameter rather than a capture: a coroutine keeps its parameters in
+// its frame, but a lambda's captures live in the closure, which a call on a temporary destroys
+// while the coroutine is still suspended.
+Detached collect_updates(
+    AsyncGenerator<BoundsChange> &changes, const ScriptedSource &source,
+    const std::vector<double> &timestamps, std::vector<BoundsChange> &updates,
+    std::vector<size_t> &consumed, bool &done
+) {
+    while (std::optional<BoundsChange> change = co_await changes.next()) {
+        // The next batch is always already requested
+        assert(source.requests == source.delivered + 1);
+        const bool publish = change->time == timestamps[source.offset - 1];
+        consumed.push_back(publish? source.offset: source.offset - source.last_size);
+        updates.push_back(*change);
+    }
+    done = true;
+}
+
+// Runs a pipeline over batches of frames to the end, and returns its updates, along with how many
+// frames it had consumed as of each: a publish follows its batch, and an expiry precedes it
+std::vector<BoundsChange> pipeline_updates(
+    const std::vector<double> &timestamps, const std::vector<uint8_t> &bytes,
+    const std::vector<size_t> &sizes, std::vector<size_t> &consumed
+) {
+    ScriptedSource::Loop loop;
+    ScriptedSource source(loop, timestamps, bytes, sizes);
+    Photometer meter;
+    AsyncGenerator<BoundsChange> changes = frame_pipeline(source, meter);
+    std::vector<BoundsChange> updates;
+    bool done = false;
+    collect_updates(changes, source, timestamps, updates, consumed, done);
+    while (!loop.empty()) {
+        const std::coroutine_handle<> reader = loop.front();
+        loop.pop_front();
+        reader.resume();
+    }
+    assert(done && source.delivered == sizes.size());
+    assert(meter.estimate(timestamps.back()) == updates.back().estimate);
+    return updates;
+}
+
+void test_pipeline() {
+    std::cout << "test_pipeline\n";
+    // An expiry at the time of a batch is reported with the batch's change
+    {
+        const std::vector<double> timestamps = { 1.0, 1.0 + kHorizonS[2] };
+        const std::vector<uint8_t> bytes = {
+            0x30u, 0x21u,  // conf=0 clear=0 value=64820 sign=0 horizon=0.066
+            0x1u, 0x08u,   // conf=1 clear=0 value=50000 sign=1 horizon=0.0165
+        };
+        std::vector<size_t> consumed;
+        const std::vector<BoundsChange> updates = pipeline_updates(timestamps, bytes, { 1, 0, 1 }, consumed);
+        assert(updates.size() == 2);
+        assert(updates[0].time == 1.0 && updates[0].lower == 64820 && updates[0].upper == 100e3);
+        assert(updates[1].time == timestamps[1] && updates[1].lower == 0 && updates[1].upper == 50e3);
+        assert(consumed[0] == 1 && consumed[1] == 2);
+    }
+
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 8, seed % 2? 300: 0);
+        std::vector<double> timestamps;
+        std::vector<uint8_t> bytes;
+        double now = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            timestamps.push_back(now);
+            bytes.insert(bytes.end(), data, data + 2);
+        }
+
+        // Single frames, and then batches of up to a few blocks, some empty
+        std::vector<size_t> sizes;
+        std::mt19937 gen(seed);
+        for (size_t total = 0, n; total < timestamps.size(); total += n) {
+            n = std::min(
+                timestamps.size() - total,
+                seed < 2? 1: std::uniform_int_distribution<size_t>(0, 600)(gen)
+            );
+            sizes.push_back(n);
+        }
+
+        std::vector<size_t> consumed;
+        const std::vector<BoundsChange> updates = pipeline_updates(timestamps, bytes, sizes, consumed);
+
+        // One by one through a meter of its own, the updates must be every change there is
+        // between batches, and with single frames, the same as ChangeNotifier's
+        Photometer reference;
+        ChangeNotifier<> notifier;
+        std::vector<BoundsChange> expected;
+        notifier.subscribe([&expected](const BoundsChange &change) { expected.push_back(change); });
+        size_t fed = 0;
+        assert(!updates.empty());
+        for (size_t i = 0; i < updates.size(); i++) {
+            for (; fed < consumed[i]; fed++) {
+                const uint8_t data[2] = { bytes[2*fed], bytes[2*fed + 1] };
+                reference.consume(timestamps[fed], data);
+                notifier.consume(timestamps[fed], data);
+            }
+            assert(updates[i].lower == reference.lower(updates[i].time));
+            assert(updates[i].upper == reference.upper(updates[i].time));
+            if (i > 0) {
+                assert(updates[i].time >= updates[i - 1].time);
+                assert(updates[i].lower != updates[i - 1].lower || updates[i].upper != updates[i - 1].upper);
+            }
+        }
+        for (; fed < timestamps.size(); fed++) {
+            const uint8_t data[2] = { bytes[2*fed], bytes[2*fed + 1] };
+            reference.consume(timestamps[fed], data);
+            notifier.consume(timestamps[fed], data);
+        }
+        assert(updates.back().estimate == reference.estimate(now));
+        if (seed < 2) {
+            assert(expected.size() == updates.size());
+            for (size_t i = 0; i < updates.size(); i++)
+                assert(updates[i].time == expected[i].time && updates[i].estimate == expected[i].estimate);
+        }
+    }
+}
+
+void test_memory() {
+    std::cout << "test_memory\n";
+    for (unsigned seed = 0; seed < 2; seed++) {
+        FrameGenerator frames(seed, 8, 300);
+        CountingResource counter, other, trap;
+        {
+            // Nothing the meter does allocates from anywhere else
+            Photometer reference;
+            std::pmr::memory_resource *previous = std::pmr::set_default_resource(&trap);
+            Photometer meter(&counter);
+            meter.set_incremental(seed == 1);
+            assert(meter.resource() == &counter);
+            double now = 0;
+            std::vector<double> series(50), expected(50);
+            for (int i = 0; i < 2000; i++) {
+                now = frames.advance(now);
+                uint8_t data[2];
+                frames.next(data);
+                meter.consume(now, data);
+                reference.consume(now, data);
+                assert(meter.estimate(now + 0.05) == reference.estimate(now + 0.05));
+                if (i % 100 == 0) {
+                    meter.estimate_series(now, 1e-3, series.size(), series.data());
+                    reference.estimate_series(now, 1e-3, expected.size(), expected.data());
+                    assert(series == expected);
+                }
+                assert(counter.bytes() <= counter.peak_bytes());
+            }
+            std::pmr::set_default_resource(previous);
+            assert(trap.allocations() == 0);
+            assert(counter.allocations() > 0 && counter.bytes() > 0);
+            counter.reset_peak();
+            assert(counter.peak_bytes() == counter.bytes());
+
+            // Moves keep the resource; copies and assignments leave it behind
+            Photometer moved(std::move(meter));
+            assert(moved.resource() == &counter);
+            const Photometer copy(moved), counted(moved, &other);
+            assert(copy.resource() == std::pmr::get_default_resource());
+            assert(counted.resource() == &other && other.bytes() > 0);
+            Photometer assigned(&other);
+            assigned = moved;
+            assert(assigned.resource() == &other);
+            const auto matches = [&](const Photometer &meter) {
+                return meter.estimate(now) == reference.estimate(now)
+                    && meter.estimate(now + 0.1) == reference.estimate(now + 0.1);
+            };
+            assert(matches(copy) && matches(counted) && matches(assigned));
+        }
+        assert(counter.bytes() == 0 && other.bytes() == 0);
+    }
+}
+
+bool same_resolution(const Photometer::Resolution &a, const Photometer::Resolution &b) {
+    return a.lower == b.lower && a.upper == b.upper
+        && a.lower_confidence == b.lower_confidence && a.upper_confidence == b.upper_confidence
+        && a.lower_end == b.lower_end && a.upper_end == b.upper_end;
+}
+
+void test_incremental() {
+    std::cout << "test_incremental\n";
+    for (unsigned seed = 0; seed < 8; seed++) {
+        FrameGenerator frames(seed, seed < 4? 6: 12, seed % 2? 200: 0, seed % 4 >= 2);
+        Photometer meter, incremental;
+        incremental.set_incremental(true);
+        if (seed == 5)
+            incremental.set_expiry_budget(2);
+        double now = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            incremental.consume(now, data);
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                assert(same_resolution(incremental.resolve(future), meter.resolve(future)));
+
+            // Switched on part way, and copied
+            if (i == 1500) {
+                meter.set_incremental(true);
+                const Photometer copy(incremental), future(incremental, now + 0.1);
+                assert(same_resolution(copy.resolve(now), meter.resolve(now)));
+                assert(same_resolution(future.resolve(now + 0.2), meter.resolve(now + 0.2)));
+                incremental = copy;
+            }
+        }
+    }
+
+    // The tightest bound of confidence 1 is overridden, but a looser one is in effect
+    Photometer meter;
+    meter.set_incremental(true);
+    meter.consume(Sample(1.0, 3.0, false, 40e3, false, 1));
+    meter.consume(Sample(1.1, 2.0, false, 60e3, false, 1));
+    meter.consume(Sample(1.2, 2.5, true, 50e3, false, 3));
+    assert(is_close(meter.lower(1.5), 40e3) && is_close(meter.upper(1.5), 50e3));
+    assert(meter.resolve(1.5).lower_end == 3.0);
+    assert(is_close(meter.lower(2.2), 40e3) && is_close(meter.lower(2.6), 40e3));
+    assert(meter.resolve(2.6).upper_end == std::numeric_limits<double>::infinity());
+}
+
+void test_checkpoint() {
+    std::cout << "test_checkpoint\n";
+    std::vector<uint8_t> bytes;
+    Photometer().checkpoint(0, bytes);
+    assert(bytes.size() == checkpoint::kHeaderBytes);
+
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 15, seed % 2? 300: 0);
+        Photometer meter;
+        double now = 100;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+        }
+
+        bytes.assign(3, 0xaa);  // appended to whatever is already there
+        meter.checkpoint(now, bytes);
+        const uint8_t *checkpoint = bytes.data() + 3;
+        const size_t size = bytes.size() - 3;
+        assert(size == checkpoint::kHeaderBytes + checkpoint::kSampleBytes*meter.size());
+
+        // Restored on a clock that has started again, the same bounds follow. Probes stay off the
+        // 0.5 ms grid of sample ends, which move by up to 0.5 us.
+        Photometer restored;
+        const double boot = 0.25;
+        assert(restored.restore(boot, checkpoint, size));
+        assert(restored.size() == meter.size());
+        for (double future: {0.0, 0.00023, 0.01023, 0.5, 3.3, 10.00023, 600.0}) {
+            assert(restored.lower(boot + future) == meter.lower(now + future));
+            assert(restored.upper(boot + future) == meter.upper(now + future));
+        }
+
+        // Torn or corrupted checkpoints leave the meter as it was
+        std::vector<uint8_t> corrupt(checkpoint, checkpoint + size);
+        corrupt[checkpoint::kHeaderBytes + 7] ^= 0x10;
+        assert(!restored.restore(0, corrupt.data(), corrupt.size()));
+        assert(!restored.restore(0, checkpoint, size - 1));
+        assert(!restored.restore(0, checkpoint, 10));
+        assert(restored.size() == meter.size());
+        assert(restored.estimate(boot + 3.3) == meter.estimate(now + 3.3));
+
+        // Nor is one restored on the other clock, or with its clock byte flipped
+        assert(!restored.restore(Ticks(0), checkpoint, size));
+        corrupt.assign(checkpoint, checkpoint + size);
+        corrupt[16] = static_cast<uint8_t>(ClockKind::ticks);
+        assert(!restored.restore(Ticks(0), corrupt.data(), corrupt.size()));
+        assert(restored.size() == meter.size());
+    }
+
+    // On ticks, starts are kept to the microsecond, and ends are exact again from there, even for
+    // starts before tick 0 when restored soon after boot
+    for (unsigned seed = 0; seed < 2; seed++) {
+        FrameGenerator frames(seed, 15, seed? 300: 0);
+        Photometer meter;
+        uint64_t now = 123456789012340;
+        for (int i = 0; i < 3000; i++) {
+            now += frames.advance(0) == 0? 0: 10000;  // 1 ms
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(Ticks(now), data);
+        }
+        bytes.clear();
+        meter.checkpoint(Ticks(now), bytes);
+        assert(bytes.size() == checkpoint::kHeaderBytes + checkpoint::kSampleBytes*meter.size());
+
+        Photometer restored;
+        const uint64_t boot = 2500000;  // 0.25 s
+        assert(!restored.restore(0.25, bytes.data(), bytes.size()));
+        assert(restored.restore(Ticks(boot), bytes.data(), bytes.size()));
+        assert(restored.size() == meter.size());
+        for (uint64_t future: {0ull, 2300ull, 165000ull, 5000000ull, 33000000ull, 6000000000ull}) {
+            assert(restored.lower(Ticks(boot + future)) == meter.lower(Ticks(now + future)));
+            assert(restored.upper(Ticks(boot + future)) == meter.upper(Ticks(now + future)));
+        }
+
+        // Consuming on again keeps to ticks
+        uint8_t data[2];
+        frames.next(data);
+        restored.consume(Ticks(boot + 10000), data);
+        meter.consume(Ticks(now + 10000), data);
+        assert(restored.estimate(Ticks(boot + 20000)) == meter.estimate(Ticks(now + 20000)));
+    }
+}
+
+void test_concurrent_estimates() {
+    std::cout << "test_concurrent_estimates\n";
+    for (bool incremental: {false, true}) {
+        Photometer meter;
+        meter.set_incremental(incremental);
+        FrameGenerator frames(7);
+        double now = 0;
+        for (int i = 0; i < 500; i++) {
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now = frames.advance(now), data);
+        }
+        std::vector<double> times, expected;
+        for (double t = now - 0.5; t < now + 3; t += 0.0007)
+            times.push_back(t);
+        for (double t: times)
+            expected.push_back(Photometer(meter).estimate(t));
+
+        // Const calls from several threads at once, borrowing the meter's workspace or not, or
+        // each with a workspace of its own, give the same estimates as a single thread
+        std::atomic<bool> same = true;
+        std::vector<std::thread> threads;
+        for (int id = 0; id < 4; id++) {
+            threads.emplace_back([&, id]() {
+                Photometer::Workspace workspace;
+                for (int pass = 0; pass < 20; pass++) {
+                    for (size_t i = 0; i < times.size(); i++) {
+                        const double estimate = id % 2
+                            ? meter.estimate(times[i], workspace)
+                            : meter.estimate(times[i]);
+                        if (estimate != expected[i] || meter.resolve(times[i]).midpoint != expected[i])
+                            same = false;
+                    }
+                }
+            });
+        }
+        for (std::thread &thread: threads)
+            thread.join();
+        assert(same);
+
+        // A workspace moved between meters, or kept across a change, only misses its cache
+        Photometer::Workspace workspace;
+        Photometer other;
+        other.consume(now, (const uint8_t[2]){ 0x30u, 0x21u });
+        const double before = meter.estimate(now);
+        assert(meter.estimate(now, workspace) == before);
+        assert(other.estimate(now, workspace) == other.estimate(now));
+        meter.consume(now, (const uint8_t[2]){ 0x4u, 0x0u });  // CLR, then a lower bound of 50000
+        assert(meter.estimate(now, workspace) == 75e3 && before != 75e3);
+
+        // Or across a move, which leaves the meter moved from empty, and its samples cached as
+        // they were in the meter moved to
+        Photometer moved(std::move(meter));
+        assert(meter.size() == 0 && meter.estimate(now, workspace) == 50e3);
+        assert(moved.estimate(now, workspace) == 75e3);
+        meter = std::move(moved);
+        assert(moved.size() == 0 && moved.estimate(now, workspace) == 50e3);
+        assert(meter.estimate(now, workspace) == 75e3);
+    }
+}
+
+void test_resolve() {
+    std::cout << "test_resolve\n";
+    Photometer meter;
+    Photometer::Resolution r = meter.resolve(0);
+    assert(r.lower == 0 && r.upper == 100e3 && r.midpoint == 50e3 && r.width() == 100e3);
+    assert(r.lower_confidence == 0 && r.lower_end == std::numeric_limits<double>::infinity());
+
+    meter.consume(Sample(1.0, 2.0, false, 40e3, false, 2));
+    meter.consume(Sample(1.1, 1.5, true, 20e3, false, 3));
+    r = meter.resolve(1.2);
+    assert(r.lower == 0 && r.upper == 20e3 && r.midpoint == 10e3);
+    assert(r.lower_end == std::numeric_limits<double>::infinity());
+    assert(r.upper_confidence == 3 && r.upper_end == 1.5);
+    r = meter.resolve(1.5);
+    assert(r.lower == 40e3 && r.lower_confidence == 2 && r.lower_end == 2.0);
+    assert(r.upper == 100e3 && r.upper_confidence == 0);
+    r = meter.resolve();
+    assert(r.lower == 0 && r.upper == 20e3);
+
+    // Of equal bounds, the one ending last gives the expiry
+    meter.consume(Sample(1.5, 3.0, false, 40e3, false, 1));
+    r = meter.resolve(1.6);
+    assert(r.lower == 40e3 && r.lower_confidence == 1 && r.lower_end == 3.0);
+
+    FrameGenerator frames(7, 9, 500);
+    Photometer random;
+    double now = 0;
+    for (int i = 0; i < 3000; i++) {
+        now = frames.advance(now);
+        uint8_t data[2];
+        frames.next(data);
+        random.consume(now, data);
+        for (double t: {now, now + 0.1}) {
+            r = random.resolve(t);
+            assert(r.lower == random.lower(t) && r.upper == random.upper(t));
+            assert(r.midpoint == random.estimate(t));
+            assert(r.lower_end > t && r.upper_end > t);
+            assert(r.lower_end == std::numeric_limits<double>::infinity() || r.lower > 0);
+        }
+    }
+}
+
+void test_series() {
+    std::cout << "test_series\n";
+    Photometer meter;
+    double out[8];
+    assert(meter.estimate_series(0, 1, 0.25, out) == 5);
+    for (size_t i = 0; i < 5; i++)
+        assert(out[i] == 50e3);
+    assert(Photometer::series_size(1, 0, 0.25) == 0);
+
+    // The lower bound is overridden until the upper bound ends, and the later lower bound is
+    // overridden by it for its whole span
+    meter.consume(Sample(1.0, 2.0, false, 40e3, false, 0));
+    meter.consume(Sample(1.1, 1.5, true, 20e3, false, 1));
+    meter.consume(Sample(1.2, 1.4, false, 60e3, false, 0));
+    assert(meter.estimate_series(1.25, 2.75, 0.25, out) == 7);
+    const double expected[7] = { 10e3, 70e3, 70e3, 50e3, 50e3, 50e3, 50e3 };
+    for (size_t i = 0; i < 7; i++)
+        assert(out[i] == expected[i]);
+
+    for (unsigned seed = 0; seed < 8; seed++) {
+        FrameGenerator frames(seed, seed < 4? 9: 13, seed % 2? 700: 0, seed % 3 == 0);
+        Photometer meter, resumed;
+        resumed.set_incremental(seed % 4 < 2);
+        Photometer::Workspace workspace;
+        std::vector<double> series;
+        double now = 0;
+        for (int block = 0; block < 20; block++) {
+            for (int i = 0; i < 300; i++) {
+                now = frames.advance(now);
+                uint8_t frame[2];
+                frames.next(frame);
+                meter.consume(now, frame);
+                resumed.consume(now, frame);
+
+                // Short series between consumes, resumed from the workspace, match the full sweep
+                double fresh[3], kept[3];
+                meter.estimate_series(now, 5e-4, std::size(fresh), fresh);
+                resumed.estimate_series(now, 5e-4, std::size(kept), kept, workspace);
+                assert(std::equal(std::begin(fresh), std::end(fresh), kept));
+            }
+            // Includes points before the latest consume, at sample starts and ends on the grid
+            const double t0 = now - 0.1, t1 = now + 10, step = seed % 2? 1e-3: 0.0165;
+            series.resize(Photometer::series_size(t0, t1, step));
+            assert(meter.estimate_series(t0, t1, step, series.data()) == series.size());
+            for (size_t i = 0; i < series.size(); i++)
+                assert(series[i] == meter.estimate(t0 + i*step));
+        }
+    }
+}
+
+void test_capture() {
+    std::cout << "test_capture\n";
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 11, seed % 2? 300: 0);
+        CaptureWriter writer;
+        Photometer direct;
+        std::vector<double> timestamps;
+        double now = 1000 + seed;
+        for (size_t i = 0; i < 3000 + seed*777; i++) {
+            now = frames.advance(now);
+            if (i % 1000 == 999)
+                now += 1e3;  // long gaps take more bytes per delta
+            uint8_t frame[2];
+            frames.next(frame);
+            writer.add(now, frame);
+            timestamps.push_back(now);
+        }
+
+        std::ostringstream out;
+        writer.write(out);
+        const std::string bytes = out.str();
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes.data());
+        const std::optional<CaptureView> capture = CaptureView::open(data, bytes.size());
+        assert(capture && capture->size() == writer.size());
+
+        // Timestamps are within half a tick, and the frames are the same bytes in the same order
+        size_t i = 0;
+        capture->for_each_block([&](const double *ts, const uint8_t (*fs)[2], size_t n) {
+            assert(n <= FrameBlock::kCapacity);
+            for (size_t j = 0; j < n; j++, i++) {
+                assert(std::fabs(ts[j] - timestamps[i]) <= 0.5*capture->tick_s() + 1e-9);
+                direct.consume(ts[j], fs[j]);
+            }
+        });
+        assert(i == timestamps.size());
+
+        Photometer batched;
+        WheelPhotometer wheel;
+        const double last = capture->replay(batched);
+        assert(capture->replay(wheel) == last);
+        assert(batched.size() == direct.size());
+        for (double future: {last, last + 1, last + 100})
+            assert(batched.estimate(future) == direct.estimate(future));
+        assert(wheel.estimate(last) == direct.estimate(last));
+
+        // Truncated or trailing bytes are rejected
+        assert(!CaptureView::open(data, bytes.size() - 1));
+        assert(!CaptureView::open(data, 16));
+        const std::string longer = bytes + '\0';
+        assert(!CaptureView::open(reinterpret_cast<const uint8_t *>(longer.data()), longer.size()));
+    }
+
+    std::ostringstream out;
+    CaptureWriter().write(out);
+    const std::string empty = out.str();
+    const std::optional<CaptureView> capture =
+        CaptureView::open(reinterpret_cast<const uint8_t *>(empty.data()), empty.size());
+    assert(capture && capture->size() == 0);
+
+    // Deltas corrupted to wrap around 64 bits, alone or in sum, or to run past ten bytes are
+    // rejected, so that timestamps never decrease
+    const auto with_deltas = [&empty](std::vector<std::vector<uint8_t>> deltas) {
+        std::string bytes = empty;
+        capture::put_u64(reinterpret_cast<uint8_t *>(bytes.data()) + 8, deltas.size());
+        bytes.append(2*deltas.size(), '\0');
+        for (const std::vector<uint8_t> &delta: deltas)
+            bytes.append(delta.begin(), delta.end());
+        return CaptureView::open(reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size()).has_value();
+    };
+    const std::vector<uint8_t> zero = { 0x00u }, one = { 0x01u }, padded_zero(9, 0x80u),
+        largest = { 0xffu, 0xffu, 0xffu, 0xffu, 0xffu, 0xffu, 0xffu, 0xffu, 0xffu, 0x01u };
+    std::vector<uint8_t> overflowing = largest, eleven_bytes(10, 0x80u);
+    overflowing.back() = 0x02u;
+    eleven_bytes.push_back(0x00u);
+    std::vector<uint8_t> ten_bytes = padded_zero;
+    ten_bytes.push_back(0x00u);
+    assert(with_deltas({ zero, largest }) && with_deltas({ zero, ten_bytes, one }));
+    assert(!with_deltas({ zero, overflowing }));
+    assert(!with_deltas({ zero, largest, one }));
+    assert(!with_deltas({ zero, eleven_bytes }));
+    assert(!with_deltas({ zero, padded_zero }));
+}
+
+void test_work_pool() {
+    std::cout << "test_work_pool\n";
+    for (unsigned threads: {1u, 4u}) {
+        std::vector<std::atomic<int>> runs(200);
+        std::atomic<unsigned> nested = 0;
+        {
+            WorkStealingPool pool(threads);
+            assert(pool.threads() == threads);
+            for (size_t i = 0; i < runs.size(); i++) {
+                pool.submit([&, i]() {
+                    // Uneven costs, and tasks that submit more tasks
+                    if (i % 50 == 0)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    if (i % 10 == 0)
+                        pool.submit([&]() { nested++; });
+                    runs[i]++;
+                });
+            }
+            pool.wait();
+            assert(nested == 20);
+            for (const std::atomic<int> &run: runs)
+                assert(run == 1);
+
+            // Tasks still queued when the pool is destroyed are run first
+            for (size_t i = 0; i < runs.size(); i++)
+                pool.submit([&, i]() { runs[i]++; });
+        }
+        for (const std::atomic<int> &run: runs)
+            assert(run == 2);
+    }
+}
+
+void test_batch() {
+    std::cout << "test_batch\n";
+    for (unsigned seed = 0; seed < 6; seed++) {
+        FrameGenerator frames(seed, seed < 3? 8: 15, seed % 2? 500: 0);
+        Photometer single, batched;
+        std::vector<double> timestamps;
+        std::vector<std::array<uint8_t, 2>> data;
+        double now = 0;
+        for (size_t n: {1, 7, 256, 257, 1000, 4096, 600}) {
+            timestamps.clear();
+            data.clear();
+            for (size_t i = 0; i < n; i++) {
+                now = frames.advance(now);
+                uint8_t frame[2];
+                frames.next(frame);
+                single.consume(now, frame);
+                timestamps.push_back(now);
+                data.push_back({frame[0], frame[1]});
+            }
+            batched.consume_batch(
+                timestamps.data(), reinterpret_cast<const uint8_t (*)[2]>(data.data()), n
+            );
+            assert(batched.size() == single.size());
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                assert(batched.estimate(future) == single.estimate(future));
+        }
+    }
+}
+
+void test_frame_parser() {
+    std::cout << "test_frame_parser\n";
+    // Bounds scattered around a drifting illuminance, as sent by a working sensor
+    std::mt19937 gen(22);
+    std::uniform_int_distribution<int> coin(0, 1), confidence(0, 3), offset(0, 8), horizon(0, 9);
+    std::vector<uint8_t> stream;
+    int truth = 0;
+    for (int i = 0; i < 4000; i++) {
+        if (i % 50 == 0)
+            truth = std::clamp(truth + (coin(gen)? 3: -3), -100, 100);
+        const unsigned sign = coin(gen);
+        const int value = sign? truth + offset(gen): truth - offset(gen);
+        const uint16_t word = confidence(gen) | (value & 0xff) << 3 | sign << 11 | horizon(gen) << 12;
+        stream.push_back(word & 0xff);
+        stream.push_back(word >> 8);
+    }
+
+    struct Recorder {
+        void consume_batch(const double *timestamps, const uint8_t (*data)[2], size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                assert(timestamps[i] == timestamps[0]);
+                times.push_back(timestamps[i]);
+                frames.push_back({ data[i][0], data[i][1] });
+            }
+        }
+        std::vector<double> times;
+        std::vector<std::array<uint8_t, 2>> frames;
+    };
+
+    // A dropped byte, or a stray one before the first frame
+    for (int dropped: {-1, 1001, 1002, 6001, -2}) {
+        std::vector<uint8_t> received = stream;
+        if (dropped >= 0)
+            received.erase(received.begin() + dropped);
+        // Read out of phase, the stray byte begins a frame with CLR and confidence 3
+        else if (dropped == -2)
+            received.insert(received.begin(), 0x0fu);
+
+        // Chunks of every size from 0 to 37 bytes, including odd sizes that split frames
+        FrameParser parser;
+        Recorder recorder;
+        Photometer meter;
+        FrameParser live;
+        double now = 0;
+        for (size_t i = 0, size = 0; i < received.size(); i += size, size = (size + 7) % 38) {
+            const std::span<const uint8_t> chunk(
+                received.data() + i, std::min(size, received.size() - i)
+            );
+            now = i*1e-4;
+            parser.feed(now, chunk, recorder);
+            live.feed(now, chunk, meter);
+            assert(parser.frames() + parser.dropped() + 2*FrameParser::kWindow >= (i + chunk.size())/2);
+        }
+        parser.flush(recorder);
+        live.flush(meter);
+        assert(parser.frames() == recorder.frames.size());
+        assert(live.frames() == parser.frames() && live.resyncs() == parser.resyncs());
+
+        // No misaligned frame gets through: what is consumed is the stream less one run of
+        // frames where it was out of phase
+        size_t lost = 0;
+        while (lost < recorder.frames.size()
+            && recorder.frames[lost][0] == stream[2*lost] && recorder.frames[lost][1] == stream[2*lost + 1])
+            lost++;
+        const size_t resumed = stream.size()/2 - (recorder.frames.size() - lost);
+        for (size_t i = lost; i < recorder.frames.size(); i++) {
+            assert(recorder.frames[i][0] == stream[2*(resumed + i - lost)]);
+            assert(recorder.frames[i][1] == stream[2*(resumed + i - lost) + 1]);
+        }
+        if (dropped == -1) {
+            assert(parser.resyncs() == 0 && parser.dropped() == 0);
+            assert(recorder.frames.size() == stream.size()/2);
+        }
+        else {
+            // Back in phase within a window or two
+            assert(parser.resyncs() == 1);
+            assert(resumed - lost <= 3*FrameParser::kWindow);
+            assert(parser.frames() + parser.dropped() == (received.size() - 1)/2);
+        }
+
+        // So the meter is as if fed only the frames in phase
+        Photometer clean;
+        for (size_t i = 0; i < recorder.frames.size(); i++) {
+            const uint8_t data[2] = { recorder.frames[i][0], recorder.frames[i][1] };
+            clean.consume(recorder.times[i], data);
+        }
+        for (double t: {now, now + 0.05, now + 1., now + 600.})
+            assert(meter.estimate(t) == clean.estimate(t));
+    }
+}
+
+void test_frame_queue() {
+    std::cout << "test_frame_queue\n";
+    constexpr int kFrames = 200000;
+    FrameQueue<1024> queue;
+    FrameGenerator frames(6, 10, 1000);
+    std::vector<double> timestamps;
+    std::vector<std::array<uint8_t, 2>> data;
+    double now = 0;
+    for (int i = 0; i < kFrames; i++) {
+        now = frames.advance(now);
+        uint8_t frame[2];
+        frames.next(frame);
+        timestamps.push_back(now);
+        data.push_back({frame[0], frame[1]});
+    }
+
+    // Full queues drop new frames
+    for (int i = 0; i < 1024; i++)
+        assert(queue.push(timestamps[i], { data[i][0], data[i][1] }));
+    assert(!queue.push(timestamps[0], { data[0][0], data[0][1] }));
+    assert(queue.dropped() == 1 && queue.size() == 1024);
+    Photometer discard;
+    assert(queue.drain(discard) == 1024 && queue.size() == 0);
+
+    std::thread producer([&]() {
+        for (int i = 0; i < kFrames; i++) {
+            while (!queue.push(timestamps[i], { data[i][0], data[i][1] }))
+                std::this_thread::yield();
+        }
+    });
+    Photometer drained, direct;
+    for (int consumed = 0; consumed < kFrames;)
+        consumed += queue.drain(drained);
+    producer.join();
+
+    for (int i = 0; i < kFrames; i++)
+        direct.consume(timestamps[i], { data[i][0], data[i][1] });
+    assert(drained.size() == direct.size());
+    for (double future: {now, now + 0.1, now + 1.})
+        assert(drained.estimate(future) == direct.estimate(future));
+}
+
+void test_seqlock() {
+    std::cout << "test_seqlock\n";
+    // Every field of every published value is equal, so a torn read would show a mismatch
+    struct Words {
+        uint64_t a, b, c, d, e;
+    };
+    SeqLock<Words> lock;
+    std::atomic<bool> done = false;
+    std::thread writer([&]() {
+        for (uint64_t i = 1; i <= 200000; i++)
+            lock.store(Words { i, i, i, i, i });
+        done = true;
+    });
+    uint64_t last = 0;
+    while (!done) {
+        const Words w = lock.load();
+        assert(w.a == w.b && w.b == w.c && w.c == w.d && w.d == w.e);
+        assert(w.a >= last);
+        last = w.a;
+    }
+    writer.join();
+    assert(lock.load().a == 200000);
+}
+
+void test_published() {
+    std::cout << "test_published\n";
+    PublishedPhotometer meter;
+    assert(meter.estimate(0) == std::optional<double>(50e3));
+
+    meter.consume(1.0, (const uint8_t[2]){ 0x38u, 0x67u });  // conf=0 clear=0 value=40250 sign=0 horizon=1.056
+    meter.consume(1.0, (const uint8_t[2]){ 0xa1u, 0x5du });  // conf=1 clear=0 value=20360 sign=1 horizon=0.528
+    assert(is_close(*meter.estimate(1.2), 0.5*20360));
+    assert(meter.snapshot().until == 1.0 + 0.528);
+
+    // Stale once the upper bound expires, until the writer refreshes
+    assert(!meter.estimate(1.7));
+    meter.refresh(1.7);
+    assert(is_close(*meter.estimate(1.7), (40250 + 100e3)*0.5));
+    assert(is_close(*meter.estimate(1.7), meter.writer_meter().estimate(1.7)));
+
+    // With refresh() scheduled at every snapshot's until, readers always get the writer's estimate,
+    // including across gaps between frames longer than the bounds hold
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, 8, seed % 2? 300: 0);
+        PublishedPhotometer published;
+        double now = 0;
+        size_t refreshes = 0;
+        for (int i = 0; i < 2000; i++) {
+            const double next = i % 100 == 99? now + 5: frames.advance(now);
+            // Readers between each event and the next, with the timer refreshing at every expiry
+            // up to the next frame; one at its time comes with it
+            for (double event = now;; refreshes++) {
+                const double until = published.snapshot().until, upto = std::min(until, next);
+                for (double probe: {event, 0.5*(event + upto), std::nextafter(upto, event)}) {
+                    if (probe < event || probe >= upto)
+                        continue;
+                    const std::optional<double> estimate = published.estimate(probe);
+                    assert(estimate && *estimate == published.writer_meter().estimate(probe));
+                }
+                if (until >= next)
+                    break;
+                assert(!published.estimate(until));
+                published.refresh(until);
+                event = until;
+            }
+            now = next;
+            uint8_t data[2];
+            frames.next(data);
+            published.consume(now, data);
+        }
+        assert(refreshes > 100);
+    }
+}
+
+void test_bank() {
+    std::cout << "test_bank\n";
+    constexpr size_t kSensors = 24;
+    for (unsigned threads: {1u, 3u}) {
+        PhotometerBank bank(kSensors, threads);
+        std::vector<Photometer> meters(kSensors);
+        FrameGenerator frames(threads, 9, 400);
+        std::mt19937 gen(threads);
+        std::uniform_int_distribution<uint16_t> sensor(0, kSensors - 1);
+
+        std::vector<uint16_t> ids;
+        std::vector<double> timestamps;
+        std::vector<std::array<uint8_t, 2>> data;
+        std::vector<double> estimates(kSensors);
+        double now = 0;
+        for (int block = 0; block < 50; block++) {
+            ids.clear();
+            timestamps.clear();
+            data.clear();
+            for (int i = 0; i < 200; i++) {
+                now = frames.advance(now);
+                uint8_t frame[2];
+                frames.next(frame);
+                ids.push_back(sensor(gen));
+                timestamps.push_back(now);
+                data.push_back({frame[0], frame[1]});
+                meters[ids.back()].consume(now, frame);
+            }
+            bank.consume_batch(
+                ids.data(), timestamps.data(),
+                reinterpret_cast<const uint8_t (*)[2]>(data.data()), ids.size()
+            );
+            for (double future: {now, now, now + 0.05, now + 0.5}) {
+                bank.estimate_all(future, estimates.data());
+                for (size_t id = 0; id < kSensors; id++)
+                    assert(estimates[id] == meters[id].estimate(future));
+            }
+        }
+
+        bank.consume(5, now, (const uint8_t[2]){ 0x4u, 0xf0u });  // conf=0 clear=1 value=50000 sign=0 horizon=540.672
+        meters[5].consume(now, (const uint8_t[2]){ 0x4u, 0xf0u });
+        bank.estimate_all(now, estimates.data());
+        assert(estimates[5] == meters[5].estimate(now));
+    }
+}
+
+void test_ring() {
+    std::cout << "test_ring\n";
+    // Growing while wrapped around, through several sizes, keeps the order
+    Ring<int> ring;
+    std::deque<int> model;
+    std::mt19937 gen(3);
+    for (int i = 0; i < 20000; i++) {
+        if (model.empty() || std::uniform_int_distribution<int>(0, 2)(gen)) {
+            ring.push_back(i);
+            model.push_back(i);
+        }
+        else {
+            ring.pop_front();
+            model.pop_front();
+        }
+        assert(ring.size() == model.size());
+        if (!model.empty())
+            assert(ring.front() == model.front() && ring.back() == model.back());
+    }
+    for (size_t i = 0; i < model.size(); i++)
+        assert(ring[i] == model[i]);
+    assert(ring.partition_point([&model](int v) { return v < model[model.size()/2]; }) == model.size()/2);
+}
+
+void test_wheel() {
+    std::cout << "test_wheel\n";
+    for (unsigned seed = 0; seed < 6; seed++) {
+        FrameGenerator frames(seed, seed < 3? 6: 15, seed % 2? 200: 0);
+        Photometer meter;
+        WheelPhotometer wheel;
+        double now = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            wheel.consume(now, data);
+            // Photometer also drops samples made redundant by newer ones
+            assert(wheel.size() >= meter.size());
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                assert(wheel.estimate(future) == meter.estimate(future));
+        }
+    }
+}
+
+void test_compact() {
+    std::cout << "test_compact\n";
+    static_assert(sizeof(CompactPhotometer) <= 53*1024);
+    for (unsigned seed = 0; seed < 8; seed++) {
+        // Without ties between conflicting samples of equal confidence, estimates are always exact
+        const bool ties = seed % 4 != 3;
+        FrameGenerator frames(seed, seed < 4? 6: 15, seed % 2? 200: 0, !ties);
+        Photometer meter;
+        CompactPhotometer compact;
+        double now = 0;
+        size_t checked = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            compact.consume(now, data);
+            assert(compact.size() <= 2*CompactPhotometer::kConfidences*CompactPhotometer::kValues);
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.}) {
+                if (!ties || compact.exact(future)) {
+                    assert(compact.estimate(future) == meter.estimate(future));
+                    checked++;
+                }
+            }
+        }
+        assert(checked > 1000);
+    }
+
+    // Exact while the older sample of a merged slot is valid, and not from its end: Photometer
+    // then gives the tie to the conflicting bound, which is older than the repeat, but the slot
+    // still has the older start
+    const uint8_t older[2] = { 0xcau, 0x60u };   // conf=2 clear=0 value=59750 sign=0 horizon=1.056
+    const uint8_t upper[2] = { 0x6au, 0x6eu };   // conf=2 clear=0 value=30110 sign=1 horizon=1.056
+    const uint8_t repeat[2] = { 0xcau, 0x70u };  // conf=2 clear=0 value=59750 sign=0 horizon=2.112
+    Photometer meter;
+    CompactPhotometer compact;
+    for (auto [now, data]: {
+        std::pair(-1000.0, &older), std::pair(-999.5, &upper), std::pair(-999.2, &repeat)
+    }) {
+        meter.consume(now, *data);
+        compact.consume(now, *data);
+    }
+    assert(compact.size() == 2 && meter.size() == 3);
+    const double older_end = Sample::from_raw(-1000.0, older).end();
+    assert(compact.exact(std::nextafter(older_end, -std::numeric_limits<double>::infinity())) && !compact.exact(older_end));
+    assert(compact.estimate(-999.1) == meter.estimate(-999.1));
+    assert(is_close(compact.estimate(-999.1), (59750 + 100e3)*0.5));
+    assert(is_close(meter.estimate(older_end), 0.5*30110));
+    assert(is_close(compact.estimate(older_end), (59750 + 100e3)*0.5));
+
+    // Exact again once the merged slot expires
+    const double repeat_end = Sample::from_raw(-999.2, repeat).end();
+    assert(!compact.exact(std::nextafter(repeat_end, -std::numeric_limits<double>::infinity())) && compact.exact(repeat_end));
+}
+
+void test_packed() {
+    std::cout << "test_packed\n";
+    for (unsigned seed = 0; seed < 6; seed++) {
+        FrameGenerator frames(seed, seed < 3? 6: 15, seed % 2? 200: 0);
+        Photometer meter;
+        PackedPhotometer packed;
+        double now = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            packed.consume(now, data);
+            assert(packed.size() >= meter.size());
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                assert(packed.estimate(future) == meter.estimate(future));
+        }
+    }
+}
+
+void test_bitset() {
+    std::cout << "test_bitset\n";
+    CodeSet set;
+    assert(set.empty() && set.highest() == -1 && set.lowest() == 256);
+    for (unsigned code: {0, 63, 64, 200, 255})
+        set.insert(code);
+    assert(set.highest() == 255 && set.highest(254) == 200 && set.highest(63) == 63);
+    assert(set.highest(62) == 0 && set.lowest(1) == 63 && set.lowest(65) == 200);
+    set.erase(0);
+    assert(set.highest(62) == -1 && set.contains(64) && !set.contains(0));
+
+    for (unsigned seed = 0; seed < 8; seed++) {
+        FrameGenerator frames(seed, seed < 4? 6: 15, seed % 2? 200: 0, seed % 4 == 3);
+        Photometer meter;
+        BitsetPhotometer bitset;
+        double now = 0;
+        for (int i = 0; i < 3000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            bitset.consume(now, data);
+            for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                assert(bitset.estimate(future) == meter.estimate(future));
+        }
+    }
+}
+
 // Public tests
 
 void passert(const char *desc, double value, double lower, double nom, double upper) {
@@ -483,16 +1890,18 @@ void passert(const char *desc, double value, double lower, double nom, double up
         std::cout << "  " << desc << " passed\n";
 }
 
+template <typename Meter>
 void ptest_empty() {
     std::cout << "ptest_empty\n";
-    Photometer meter;
+    Meter meter;
     passert("empty default", meter.estimate(0), 0, 50e3, 100e3);
 }
 
+template <typename Meter>
 void ptest_simple_lower() {
     std::cout << "ptest_simple_lower\n";
     // Single sample
-    Photometer meter;
+    Meter meter;
     meter.consume(1.1, (const uint8_t[2]){ 0x30u, 0x51u });  // conf=0 clear=0 value=64820 sign=0 horizon=0.528
     passert("single sample", meter.estimate(1.2), 64820, (64820 + 100000)*0.5, 100000);
 
@@ -519,10 +1928,11 @@ void ptest_simple_lower() {
     passert("sample expires on boundary", meter.estimate(2.21 + 0.264), 0, 50e3, 100e3);
 }
 
+template <typename Meter>
 void ptest_simple_upper() {
     std::cout << "ptest_simple_upper\n";
     // Single sample
-    Photometer meter;
+    Meter meter;
     meter.consume(1.1, (const uint8_t[2]){ 0x38u, 0x5fu });  // conf=0 clear=0 value=40250 sign=1 horizon=0.528
     passert("single sample", meter.estimate(1.2), 0, 0.5*40250, 40250);
 
@@ -549,26 +1959,29 @@ void ptest_simple_upper() {
     passert("sample expires on boundary", meter.estimate(2.21 + 0.264), 0, 50e3, 100e3);
 }
 
+template <typename Meter>
 void ptest_superset() {
     std::cout << "ptest_superset\n";
-    Photometer meter;
+    Meter meter;
     meter.consume(1.1, (const uint8_t[2]){ 0x0u, 0x54u });  // conf=0 clear=0 value=80 sign=0 horizon=0.528
     meter.consume(1.1, (const uint8_t[2]){ 0x38u, 0x5fu });  // conf=0 clear=0 value=40250 sign=1 horizon=0.528
     meter.consume(1.2, (const uint8_t[2]){ 0xa0u, 0x4fu });  // conf=0 clear=0 value=45320 sign=1 horizon=0.264
     passert("superset", meter.estimate(1.3), 80, 0.5*(80 + 40250), 40250);
 }
 
+template <typename Meter>
 void ptest_double_bound() {
     std::cout << "ptest_double_bound\n";
-    Photometer meter;
+    Meter meter;
     meter.consume(10e3, (const uint8_t[2]){ 0xa0u, 0x55u });  // conf=0 clear=0 value=20360 sign=0 horizon=0.528
     meter.consume(10e3, (const uint8_t[2]){ 0x38u, 0x5fu });  // conf=0 clear=0 value=40250 sign=1 horizon=0.528
     passert("double bound", meter.estimate(10000.1), 20360, (20360 + 40250)*0.5, 40250);
 }
 
+template <typename Meter>
 void ptest_override_confidence() {
     std::cout << "ptest_override_confidence\n";
-    Photometer meter;
+    Meter meter;
     // Second one wins
     meter.consume(1.0, (const uint8_t[2]){ 0x38u, 0x67u });  // conf=0 clear=0 value=40250 sign=0 horizon=1.056
     meter.consume(1.0, (const uint8_t[2]){ 0xa1u, 0x5du });  // conf=1 clear=0 value=20360 sign=1 horizon=0.528
@@ -582,35 +1995,158 @@ void ptest_override_confidence() {
     passert("first one still wins after expiry", meter.estimate(3.7), 40250, (40250 + 100e3)*0.5, 100e3);
 }
 
+template <typename Meter>
 void ptest_override_time() {
     std::cout << "ptest_override_time\n";
-    Photometer meter;
+    Meter meter;
     // First one wins
     meter.consume(-1000, (const uint8_t[2]){ 0xcau, 0x60u });  // conf=2 clear=0 value=59750 sign=0 horizon=1.056
     meter.consume(-999.9, (const uint8_t[2]){ 0x6au, 0x6eu });  // conf=2 clear=0 value=30110 sign=1 horizon=1.056
     passert("first time wins", meter.estimate(-999.8), 59750, (59750 + 100e3)*0.5, 100e3);
 }
 
+// Tests that only use the interface common to Photometer and its fixed-capacity variant
+template <typename Meter>
+void test_suite() {
+    test_empty<Meter>();
+    test_simple_lower<Meter>();
+    test_simple_upper<Meter>();
+    test_superset<Meter>();
+    test_double_bound<Meter>();
+    test_override_confidence<Meter>();
+    test_override_time<Meter>();
+}
+
+void test_engines() {
+    std::cout << "test_engines\n";
+    static_assert(Engine<Photometer> && Engine<BitsetPhotometer> && Engine<StaticPhotometer<8>>);
+    static_assert(!Engine<FrameParser> && !Engine<Sample>);
+
+    for (unsigned seed = 0; seed < 4; seed++) {
+        FrameGenerator frames(seed, seed < 2? 6: 12, seed % 2? 200: 0);
+        EngineHarness<
+            IncrementalPhotometer, InstrumentedPhotometer, WheelPhotometer, CompactPhotometer, PackedPhotometer,
+            BitsetPhotometer, StaticPhotometer<1024>, StaticPhotometer<8>
+        > harness;
+        double now = 0;
+        double timestamps[10];
+        uint8_t block[10][2];
+        for (int i = 0; i < 2000; i++) {
+            now = frames.advance(now);
+            timestamps[i % 10] = now;
+            frames.next(block[i % 10]);
+            if (i % 10 == 9) {
+                harness.consume(timestamps, block, 10);
+                for (double future: {now, now + 0.01, now + 0.3, now + 3.})
+                    assert(harness.check(future));
+            }
+        }
+        assert(harness.frames() == 2000 && harness.estimates() == 800);
+
+        // Every engine was checked every time, except CompactPhotometer when it was not exact, and
+        // the small StaticPhotometer once it evicted
+        const auto &results = harness.results();
+        assert(results[0].engine == std::string("Photometer"));
+        assert(results[4].engine == std::string("CompactPhotometer"));
+        for (size_t i = 0; i + 1 < results.size(); i++) {
+            assert(i == 4 || results[i].checked == harness.estimates());
+            assert(!results[i].differed);
+        }
+        assert(results[4].checked > harness.estimates()/4);
+        assert(results.back().checked < harness.estimates() && !results.back().differed);
+    }
+}
+
+void test_static() {
+    std::cout << "test_static\n";
+    for (unsigned seed = 0; seed < 6; seed++) {
+        FrameGenerator frames(seed, seed < 3? 5: 8, seed % 2? 100: 0, seed % 3 == 2);
+        Photometer meter;
+        StaticPhotometer<512> roomy;
+        double now = 0;
+        for (int i = 0; i < 2000; i++) {
+            now = frames.advance(now);
+            uint8_t data[2];
+            frames.next(data);
+            meter.consume(now, data);
+            roomy.consume(now, data);
+            for (double future: {now, now + 0.01, now + 0.3})
+                assert(roomy.estimate(future) == meter.estimate(future));
+        }
+        assert(roomy.evictions() == 0);
+        assert(roomy.estimate() == meter.estimate());
+    }
+
+    // When full, the lowest confidence goes first, and of those the soonest to expire
+    StaticPhotometer<3> meter;
+    meter.consume(Sample(1.0, 5.0, false, 10e3, false, 1));
+    meter.consume(Sample(1.0, 4.0, false, 20e3, false, 0));
+    meter.consume(Sample(1.0, 3.0, false, 30e3, false, 0));
+    assert(meter.size() == 3 && is_close(meter.lower(1.5), 30e3));
+    meter.consume(Sample(1.1, 6.0, false, 40e3, false, 0));
+    assert(meter.size() == 3 && meter.evictions() == 1);
+    assert(is_close(meter.lower(3.5), 40e3));
+    assert(is_close(meter.lower(4.5), 40e3));
+    meter.consume(Sample(1.2, 4.0, false, 50e3, false, 0));  // evicts nothing lower, so dropped
+    assert(meter.evictions() == 2 && is_close(meter.lower(1.5), 40e3));
+    meter.consume(Sample(1.3, 7.0, false, 60e3, false, 2));
+    assert(meter.evictions() == 3 && is_close(meter.lower(6.5), 60e3));
+    assert(is_close(meter.lower(5.5), 60e3) && !is_close(meter.lower(3.5), 20e3));
+}
+
 void test_reference() {
     test_serialise();
     test_deserialise();
-    test_empty();
-    test_simple_lower();
-    test_simple_upper();
-    test_superset();
-    test_double_bound();
-    test_override_confidence();
-    test_override_time();
+    test_decode_all();
+    test_suite<Photometer>();
+    test_suite<StaticPhotometer<16>>();
+    test_as_of();
+    test_model();
+    test_dominance();
+    test_ticks();
+    test_policy();
+    test_expiry_budget();
+    test_stats();
+    test_next_change();
+    test_notifier();
+    test_pipeline();
+    test_checkpoint();
+    test_incremental();
+    test_memory();
+    test_concurrent_estimates();
+    test_resolve();
+    test_series();
+    test_capture();
+    test_work_pool();
+    test_batch();
+    test_frame_parser();
+    test_frame_queue();
+    test_seqlock();
+    test_published();
+    test_bank();
+    test_ring();
+    test_wheel();
+    test_compact();
+    test_packed();
+    test_bitset();
+    test_engines();
+    test_static();
+}
+
+template <typename Meter>
+void ptest_suite() {
+    ptest_empty<Meter>();
+    ptest_simple_lower<Meter>();
+    ptest_simple_upper<Meter>();
+    ptest_superset<Meter>();
+    ptest_double_bound<Meter>();
+    ptest_override_confidence<Meter>();
+    ptest_override_time<Meter>();
 }
 
 void test_public() {
-    ptest_empty();
-    ptest_simple_lower();
-    ptest_simple_upper();
-    ptest_superset();
-    ptest_double_bound();
-    ptest_override_confidence();
-    ptest_override_time();
+    ptest_suite<Photometer>();
+    ptest_suite<StaticPhotometer<16>>();
 }
 
 }
@@ -0,0 +1,97 @@
+#include "capture.hpp"
+#include "counting_resource.hpp"
+#include "mapped_file.hpp"
+#include "photometer.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
+
+
+
+namespace {
+
+using namespace photometer;
+
+template <typename Meter>
+void replay(const CaptureView &capture, const char *engine) {
+    using Clock = std::chrono::steady_clock;
+    constexpr bool kCounted = std::is_constructible_v<Meter, std::pmr::memory_resource *>;
+    CountingResource memory;
+    Meter meter = [&memory]() {
+        if constexpr (kCounted)
+            return Meter(&memory);
+        else return Meter();
+    }();
+    const Clock::time_point t0 = Clock::now();
+    const double last = capture.replay(meter);
+    const Clock::time_point t1 = Clock::now();
+    std::printf(
+        "%s,%zu,%.6f,%zu,%.1f\n",
+        engine, capture.size(), std::chrono::duration<double>(t1 - t0).count(), meter.size(),
+        meter.estimate(last)
+    );
+    if constexpr (kCounted) {
+        std::fprintf(
+            stderr, "peak_bytes=%zu final_bytes=%zu allocations=%zu\n",
+            memory.peak_bytes(), memory.bytes(), memory.allocations()
+        );
+    }
+    if constexpr (requires { meter.stats(); }) {
+        const PhotometerStats &stats = meter.stats();
+        std::fprintf(
+            stderr,
+            "frames=%llu clears=%llu rejected=%llu expired=%llu overridden=%llu peak_size=%zu "
+            "consume_p50_ns=%llu consume_p99_ns=%llu\n",
+            (unsigned long long)stats.frames, (unsigned long long)stats.clears,
+            (unsigned long long)stats.rejected, (unsigned long long)stats.expired,
+            (unsigned long long)stats.overridden, stats.peak_size,
+            (unsigned long long)stats.consume_ns.quantile_ns(0.5),
+            (unsigned long long)stats.consume_ns.quantile_ns(0.99)
+        );
+    }
+}
+
+}
+
+
+// Replays a capture through an engine as fast as possible, and prints a CSV row with the time
+// taken and the final state. For Photometer, also prints what it allocated to stderr, and for
+// Instrumented, which is Photometer keeping stats, those too.
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::fprintf(stderr, "usage: %s capture [Photometer|Instrumented|Wheel|Compact|Packed|Bitset]\n", argv[0]);
+        return 2;
+    }
+    const MappedFile file(argv[1]);
+    const std::optional<CaptureView> capture = CaptureView::open(file.data, file.bytes);
+    if (!capture) {
+        std::fprintf(stderr, "%s: not a readable capture\n", argv[1]);
+        return 1;
+    }
+
+    const char *engine = argc > 2? argv[2]: "Photometer";
+    std::printf("engine,frames,replay_s,final_size,final_estimate\n");
+    if (!std::strcmp(engine, "Photometer"))
+        replay<Photometer>(*capture, engine);
+    else if (!std::strcmp(engine, "Instrumented"))
+        replay<InstrumentedPhotometer>(*capture, engine);
+    else if (!std::strcmp(engine, "Wheel"))
+        replay<WheelPhotometer>(*capture, engine);
+    else if (!std::strcmp(engine, "Compact"))
+        replay<CompactPhotometer>(*capture, engine);
+    else if (!std::strcmp(engine, "Packed"))
+        replay<PackedPhotometer>(*capture, engine);
+    else if (!std::strcmp(engine, "Bitset"))
+        replay<BitsetPhotometer>(*capture, engine);
+    else {
+        std::fprintf(stderr, "unknown engine %s\n", engine);
+        return 2;
+    }
+    return 0;
+}
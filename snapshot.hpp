@@ -0,0 +1,127 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "photometer.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+
+namespace photometer {
+
+// Sequence lock over a small trivially copyable value, for one writer and any number of readers.
+// Readers never block the writer and never take a lock; they retry if the writer was part way
+// through an update. The value is held as relaxed atomic words so that the racing reads of an
+// update in progress are well-defined, and are then discarded.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1)/sizeof(uint64_t);
+
+public:
+    explicit SeqLock(const T &value = T()) { store(value); }
+
+    // Writer only
+    void store(const T &value) {
+        std::array<uint64_t, kWords> buffer {};
+        std::memcpy(buffer.data(), &value, sizeof(T));
+
+        const unsigned s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; i++)
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        std::array<uint64_t, kWords> buffer;
+        for (;;) {
+            const unsigned before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < kWords; i++)
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (before % 2 == 0 && sequence.load(std::memory_order_relaxed) == before)
+                break;
+        }
+        T value;
+        std::memcpy(static_cast<void*>(&value), buffer.data(), sizeof(T));
+        return value;
+    }
+
+private:
+    std::atomic<unsigned> sequence = 0;  // odd while an update is in progress
+    std::atomic<uint64_t> words[kWords];
+};
+
+
+// Photometer whose effective bounds are published after every consume, so that other threads can
+// estimate without locking and without waiting on the O(n log n) resolution. consume() and
+// refresh() must all be called from one writer thread; estimate() may be called from any thread.
+//
+// Published bounds only hold until the next sample end, snapshot().until, and readers get no
+// estimate from then until the writer refreshes them. In steady light, frames can be further
+// apart than that, so the writer must also schedule refresh() at snapshot().until, after every
+// consume and every refresh, for readers to see a value at all times:
+//
+//     meter.consume(now, data);
+//     timer.set(meter.snapshot().until);  // on expiry: meter.refresh(t), then set it again
+class PublishedPhotometer {
+public:
+    PublishedPhotometer() { refresh(std::numeric_limits<double>::lowest()); }
+
+    void consume(
+        double now,               // monotonic seconds
+        const uint8_t (&data)[2]  // raw from the sensor
+    ) {
+        meter.consume(now, data);
+        refresh(now);
+    }
+
+    void consume_batch(
+        const double *timestamps,    // monotonic seconds
+        const uint8_t (*frames)[2],  // raw from the sensor
+        size_t count
+    ) {
+        if (count == 0)
+            return;
+        meter.consume_batch(timestamps, frames, count);
+        refresh(timestamps[count - 1]);
+    }
+
+    // Writer only. Re-publishes the bounds as of now; the writer must call this once the
+    // published bounds expire, at the snapshot's 'until' time, as above.
+    void refresh(
+        double now  // monotonic seconds
+    ) {
+        bounds.store(meter.bounds_as_of(now));
+    }
+
+    const Photometer &writer_meter() const { return meter; }
+
+    // Any thread
+    Photometer::Bounds snapshot() const { return bounds.load(); }
+
+    // Any thread. Empty if the published bounds do not cover now, because a sample has expired
+    // since they were published and the writer has not yet refreshed them.
+    std::optional<double> estimate(
+        double now  // monotonic seconds
+    ) const {
+        const Photometer::Bounds snap = bounds.load();
+        if (now < snap.from || now >= snap.until)
+            return std::nullopt;
+        return 0.5*(snap.lower + snap.upper);
+    }
+
+private:
+    Photometer meter;
+    SeqLock<Photometer::Bounds> bounds;
+};
+
+}
+
+#endif
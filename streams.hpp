@@ -0,0 +1,100 @@
+#ifndef STREAMS_HPP
+#define STREAMS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+// Synthetic DIMBULB frame streams for benchmarks and differential tests, each generated from a
+// fixed seed
+namespace photometer::streams {
+
+struct Frame {
+    double now;
+    uint8_t data[2];
+};
+
+enum class Stream {
+    steady,         // bounds scattered around a slowly drifting illuminance
+    long_horizon,   // as steady, but every sample has HRZ=15
+    conflict_storm, // alternating signs and confidences, every pair of bounds conflicting
+    frequent_clear, // as steady, with CLR on every 50th frame
+    tie_storm,      // conflicting pairs of equal confidence, two frames to a timestamp
+    random,         // every field but CLR uniformly random
+};
+
+struct Scenario {
+    const char *name;
+    Stream stream;
+    double rate_hz, duration_s;
+};
+
+inline constexpr Scenario scenarios[] = {
+    { "steady_500hz",         Stream::steady,         500,  20 },
+    { "steady_10khz",         Stream::steady,         10e3,  2 },
+    { "long_horizon_10khz",   Stream::long_horizon,   10e3,  2 },
+    { "conflict_storm_10khz", Stream::conflict_storm, 10e3,  2 },
+    { "frequent_clear_10khz", Stream::frequent_clear, 10e3,  2 },
+    { "tie_storm_10khz",      Stream::tie_storm,      10e3,  2 },
+    { "random_500hz",         Stream::random,         500,  20 },
+};
+
+// Illuminance estimates are requested at this rate, or on every frame if frames are slower
+inline constexpr double kEstimateRateHz = 1e3;
+
+inline std::vector<Frame> generate(const Scenario &scenario) {
+    std::mt19937 gen(2001);  // fixed, so that every run measures the same stream
+    std::uniform_int_distribution<int> coin(0, 1), confidence(0, 3), offset(0, 8),
+                                       horizon(0, 8), drift(0, 99);
+    const size_t n = scenario.rate_hz*scenario.duration_s;
+    std::vector<Frame> frames;
+    frames.reserve(n);
+
+    int truth = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (drift(gen) == 0)
+            truth = std::clamp(truth + (coin(gen)? 1: -1), -100, 100);
+
+        unsigned sign = coin(gen), conf = confidence(gen), hrz = horizon(gen), clear = 0;
+        int value = sign? truth + offset(gen): truth - offset(gen);
+        switch (scenario.stream) {
+        case Stream::steady:
+            break;
+        case Stream::long_horizon:
+            hrz = 15;
+            break;
+        case Stream::conflict_storm:
+            sign = i % 2;
+            conf = i/2 % 4;
+            value = sign? truth - 1 - offset(gen): truth + 1 + offset(gen);
+            break;
+        case Stream::frequent_clear:
+            clear = i % 50 == 0;
+            break;
+        case Stream::tie_storm:
+            sign = i % 2;
+            conf = i/4 % 4;
+            value = sign? truth - offset(gen): truth + offset(gen);
+            break;
+        case Stream::random:
+            sign = coin(gen);
+            conf = confidence(gen);
+            value = std::uniform_int_distribution<int>(-128, 127)(gen);
+            break;
+        }
+
+        const uint16_t word = conf | clear << 2 | (value & 0xff) << 3 | sign << 11 | hrz << 12;
+        frames.push_back(Frame {
+            .now = (scenario.stream == Stream::tie_storm? i/2*2: i)/scenario.rate_hz,
+            .data = { static_cast<uint8_t>(word & 0xff), static_cast<uint8_t>(word >> 8) },
+        });
+    }
+    return frames;
+}
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef WORK_POOL_HPP
+#define WORK_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace photometer {
+
+// Thread pool for coarse, independent tasks of uneven cost, such as analysing one capture file
+// each. Every worker has its own queue, which it works through from the back; an idle worker
+// steals from the front of the others' queues, so that a few long tasks do not leave workers
+// idle while short ones wait behind them.
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit WorkStealingPool(
+        unsigned threads = 0  // 0 for one per hardware thread
+    ):
+        queues(threads? threads: std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned w = 0; w < queues.size(); w++)
+            workers.emplace_back([this, w]() { work(w); });
+    }
+
+    // Runs every task submitted so far before returning
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(idle_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker: workers)
+            worker.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    size_t threads() const { return workers.size(); }
+
+    // Queues a task on the calling worker, or on each worker in turn for other threads
+    void submit(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(idle_lock);
+            Queue &queue = queues[current_pool == this? current_worker: next_queue++ % queues.size()];
+            std::lock_guard<std::mutex> queue_lock(queue.lock);
+            queue.tasks.push_back(std::move(task));
+            queued++;
+            unfinished++;
+        }
+        wake.notify_one();
+    }
+
+    // Waits until every task submitted so far, and every task they submit, has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(idle_lock);
+        done.wait(lock, [this]() { return unfinished == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool take(unsigned worker, Task &task) {
+        for (size_t i = 0; i < queues.size(); i++) {
+            Queue &queue = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+            if (i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void work(unsigned worker) {
+        current_pool = this;
+        current_worker = worker;
+        for (;;) {
+            Task task;
+            if (take(worker, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(idle_lock);
+                    queued--;
+                }
+                task();
+                std::lock_guard<std::mutex> lock(idle_lock);
+                if (--unfinished == 0)
+                    done.notify_all();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(idle_lock);
+            wake.wait(lock, [this]() { return queued > 0 || stopping; });
+            if (queued == 0)
+                return;
+        }
+    }
+
+    // Locked in this order: idle_lock, then any one queue's lock
+    std::vector<Queue> queues;
+    std::mutex idle_lock;
+    std::condition_variable wake, done;
+    size_t queued = 0, unfinished = 0, next_queue = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    static inline thread_local const WorkStealingPool *current_pool = nullptr;
+    static inline thread_local unsigned current_worker = 0;
+};
+
+}
+
+#endif